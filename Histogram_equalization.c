@@ -1,21 +1,65 @@
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <tgmath.h>
 
 #include "bmp24.h"
 #include "bmp8.h"
 #include "Histogram_equalization.h"
+#include "buffer_pool.h"
+#include "cpu_features.h"
+#include "histogram.h"
+#include "luma.h"
+#include "pixel_format.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Each band fills its own histograms; the integer sums are merged afterwards,
+// so the result does not depend on how the work was split.
+#define EQUALIZE_ROWS 16
 
 unsigned int* bmp8_computeHistogram(t_bmp8* img) {
     if (!img || !img->data) return NULL;
-    unsigned int* hist = (unsigned int*)calloc(256, sizeof(unsigned int));
+    unsigned int* hist = (unsigned int*)malloc(256 * sizeof(unsigned int));
     if (!hist) return NULL;
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        hist[img->data[i]]++;
+
+    // Row padding is not counted; the histogram sums to width * height.
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    if (histogram_view(&view, (unsigned int (*)[256])hist) != 0) {
+        free(hist);
+        return NULL;
     }
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_computeHistogram", start);
     return hist;
 }
 
+t_histogram24* bmp24_computeHistograms(t_bmp24* img) {
+    if (!img || !img->data) return NULL;
+    t_histogram24* result = (t_histogram24*)malloc(sizeof(t_histogram24));
+    if (!result) return NULL;
+
+    // Channels come out in memory order: blue, green, red.
+    double start = trace_begin();
+    unsigned int hist[PIXEL_MAX_CHANNELS][256];
+    t_view view = bmp24_view(img);
+    if (histogram_view(&view, hist) != 0) {
+        free(result);
+        return NULL;
+    }
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_computeHistograms", start);
+    memcpy(result->blue, hist[0], sizeof(result->blue));
+    memcpy(result->green, hist[1], sizeof(result->green));
+    memcpy(result->red, hist[2], sizeof(result->red));
+    return result;
+}
+
 unsigned int* bmp8_computeCDF(unsigned int* hist, unsigned int dataSize) {
     if (!hist) return NULL;
     unsigned int* hist_eq = (unsigned int*)malloc(256 * sizeof(unsigned int));
@@ -42,92 +86,414 @@ unsigned int* bmp8_computeCDF(unsigned int* hist, unsigned int dataSize) {
     return hist_eq;
 }
 
+void equalize_table(const unsigned int hist[256], unsigned int count, unsigned char lut[256]) {
+    unsigned int* hist_eq = bmp8_computeCDF((unsigned int*)hist, count);
+    for (int i = 0; i < 256; i++) {
+        lut[i] = hist_eq ? (unsigned char)hist_eq[i] : (unsigned char)i;
+    }
+    free(hist_eq);
+}
+
+void bmp8_equalizeWith(t_bmp8* img, const unsigned char lut[256]) {
+    t_pointOps ops;
+    pointOps_init(&ops);
+    pointOps_map(&ops, lut);
+    bmp8_applyPointOps(img, &ops);
+}
+
 void bmp8_equalize(t_bmp8* img) {
     if (!img || !img->data) return;
 
+    double start = trace_begin();
     unsigned int* hist = bmp8_computeHistogram(img);
     if (!hist) return;
 
-    unsigned int* hist_eq = bmp8_computeCDF(hist, img->dataSize);
+    unsigned char lut[256];
+    equalize_table(hist, (unsigned int)img->width * img->height, lut);
     free(hist);
-    if (!hist_eq) return;
+    bmp8_equalizeWith(img, lut);
+    trace_end("bmp8_equalize", start);
+}
 
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = (unsigned char)hist_eq[img->data[i]];
+// Adds target[x] - luma[x] to the blue, green and red samples of pixel x,
+// clamped to [0, 255].
+static void shiftScalar(unsigned char* pixels, int channels, const unsigned char* luma,
+                        const unsigned char* target, int count) {
+    for (int x = 0; x < count; x++) {
+        int delta = target[x] - luma[x];
+        for (int c = 0; c < 3; c++) {
+            int value = pixels[channels * x + c] + delta;
+            pixels[channels * x + c] = (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value);
+        }
     }
+}
 
-    free(hist_eq);
+#ifdef CPU_X86
+
+// The signed change splits into a raise and a lower, at most one non-zero;
+// saturating byte arithmetic then clamps exactly like the scalar path. 16
+// pixels take channels vectors; a BGRX pixel's unused byte moves along.
+TARGET_SSSE3 static void shiftSSSE3(unsigned char* pixels, int channels, const unsigned char* luma,
+                                    const unsigned char* target, int count) {
+    __m128i spread[PIXEL_MAX_CHANNELS];
+    for (int v = 0; v < channels; v++) {
+        char bytes[16];
+        for (int j = 0; j < 16; j++) {
+            bytes[j] = (char)((16 * v + j) / channels);
+        }
+        spread[v] = _mm_loadu_si128((const __m128i*)bytes);
+    }
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i l = _mm_loadu_si128((const __m128i*)(luma + x));
+        __m128i t = _mm_loadu_si128((const __m128i*)(target + x));
+        __m128i raise = _mm_subs_epu8(t, l);
+        __m128i lower = _mm_subs_epu8(l, t);
+        unsigned char* px = pixels + channels * x;
+        for (int v = 0; v < channels; v++) {
+            __m128i value = _mm_loadu_si128((const __m128i*)(px + 16 * v));
+            value = _mm_adds_epu8(value, _mm_shuffle_epi8(raise, spread[v]));
+            value = _mm_subs_epu8(value, _mm_shuffle_epi8(lower, spread[v]));
+            _mm_storeu_si128((__m128i*)(px + 16 * v), value);
+        }
+    }
+    shiftScalar(pixels + channels * x, channels, luma + x, target + x, count - x);
 }
 
-void bmp24_equalize(t_bmp24* img) {
-    if (!img || !img->data) return;
+#endif
+
+static void shiftRow(unsigned char* row, int channels, const unsigned char* luma, const unsigned char* target,
+                     int count, t_simdLevel level) {
+#ifdef CPU_X86
+    if (level >= SIMD_SSSE3) {
+        shiftSSSE3(row, channels, luma, target, count);
+        return;
+    }
+#endif
+    (void)level;
+    shiftScalar(row, channels, luma, target, count);
+}
+
+typedef struct {
+    t_bmp24* img;
+    int bands;
+    unsigned int* partial;
+    unsigned char lut[256];
+    t_simdLevel level;
+} t_equalizeJob24;
+
+static void lumaHistogramBand(void* context, int index) {
+    t_equalizeJob24* job = (t_equalizeJob24*)context;
+    t_bmp24* img = job->img;
+    int y0 = (int)((long long)img->height * index / job->bands);
+    int y1 = (int)((long long)img->height * (index + 1) / job->bands);
+
+    unsigned char* luma = (unsigned char*)bufferPool_get(img->width, 0);
+    if (!luma) return;
+    for (int y = y0; y < y1; y++) {
+        luma_row((const unsigned char*)bmp24_row(img, y), img->channels, luma, img->width, job->level);
+        histogram_add(luma, img->width, job->partial + 256 * index);
+    }
+    bufferPool_release(luma);
+}
+
+// Equalizing luma from Y to lut[Y] while keeping U and V is, through the YUV
+// matrices, the same as adding lut[Y] - Y to each of red, green and blue.
+static void remapRows24(void* context, int y0, int y1) {
+    t_equalizeJob24* job = (t_equalizeJob24*)context;
+    t_bmp24* img = job->img;
     int w = img->width;
-    int h = img->height;
-    int size = w * h;
 
-    t_yuv** yuv = (t_yuv**)malloc(h * sizeof(t_yuv*));
-    for (int i = 0; i < h; i++) {
-        yuv[i] = (t_yuv*)malloc(w * sizeof(t_yuv));
+    unsigned char* luma = (unsigned char*)bufferPool_get(2 * (size_t)w, 0);
+    if (!luma) return;
+    unsigned char* target = luma + w;
+    for (int y = y0; y < y1; y++) {
+        unsigned char* row = (unsigned char*)bmp24_row(img, y);
+        luma_row(row, img->channels, luma, w, job->level);
+        memcpy(target, luma, w);
+        pointOps_mapBytes(job->lut, target, w);
+        shiftRow(row, img->channels, luma, target, w, job->level);
     }
+    bufferPool_release(luma);
+}
 
-    unsigned int hist[256] = {0};
+int bmp24_addLumaHistogram(t_bmp24* img, unsigned int hist[256]) {
+    if (!img || !img->data) return -1;
 
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            t_pixel px = img->data[y][x];
-            float r = px.red, g = px.green, b = px.blue;
-            float Y = 0.299f * r + 0.587f * g + 0.114f * b;
-            float U = -0.14713f * r - 0.28886f * g + 0.436f * b;
-            float V = 0.615f * r - 0.51499f * g - 0.10001f * b;
-            yuv[y][x].y = Y;
-            yuv[y][x].u = U;
-            yuv[y][x].v = V;
-            int y_int = (int)round(Y);
-            if (y_int < 0) y_int = 0;
-            if (y_int > 255) y_int = 255;
-            hist[y_int]++;
+    double start = trace_begin();
+    t_equalizeJob24 job;
+    job.img = img;
+    job.level = cpu_simdLevel();
+    job.bands = threadPool_bandCount(img->height, EQUALIZE_ROWS);
+    job.partial = (unsigned int*)bufferPool_getZeroed(256 * (size_t)job.bands * sizeof(unsigned int), 0);
+    if (!job.partial) return -1;
+    threadPool_parallelFor(job.bands, lumaHistogramBand, &job);
+
+    for (int b = 0; b < job.bands; b++) {
+        for (int i = 0; i < 256; i++) {
+            hist[i] += job.partial[256 * b + i];
         }
     }
+    bufferPool_release(job.partial);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_addLumaHistogram", start);
+    return 0;
+}
 
-    unsigned int cdf[256] = {0};
-    cdf[0] = hist[0];
-    for (int i = 1; i < 256; i++) {
-        cdf[i] = cdf[i - 1] + hist[i];
+void bmp24_equalizeWith(t_bmp24* img, const unsigned char lut[256]) {
+    if (!img || !img->data) return;
+
+    double start = trace_begin();
+    t_equalizeJob24 job;
+    job.img = img;
+    job.level = cpu_simdLevel();
+    memcpy(job.lut, lut, sizeof(job.lut));
+    threadPool_forBands(img->height, EQUALIZE_ROWS, remapRows24, &job);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_equalizeWith", start);
+}
+
+// Pass 1 counts luma, pass 2 remaps it and shifts every channel by the change.
+void bmp24_equalize(t_bmp24* img) {
+    if (!img || !img->data) return;
+
+    double start = trace_begin();
+    unsigned int hist[256] = {0};
+    if (bmp24_addLumaHistogram(img, hist) != 0) return;
+
+    unsigned char lut[256];
+    equalize_table(hist, (unsigned int)img->width * img->height, lut);
+    bmp24_equalizeWith(img, lut);
+    trace_end("bmp24_equalize", start);
+}
+
+// CLAHE: each tile of a single-channel plane gets its own equalization
+// table from its clipped histogram, and every sample is mapped through the
+// four tables around it, weighted by its distance to the tile centres.
+typedef struct {
+    const t_view* plane;
+    t_bmp24* img;                   // 24-bit: the plane is its luma, filled in
+    t_simdLevel level;              // while counting
+    int tilesX;
+    int tilesY;
+    float clipLimit;
+    int bands;
+    unsigned int* partial;          // [band][tile][256]
+    unsigned char* luts;            // [tile][256], tiles row by row
+    int* columnLeft;                // per column: offsets of the left and
+    int* columnRight;               // right tables in a tile row, and the
+    int* columnWeight;              // right one's weight out of 256
+} t_claheJob;
+
+static int tileStart(int size, int tiles, int index) {
+    return (int)((long long)size * index / tiles);
+}
+
+// The two tiles whose centres surround position p along an axis, and the
+// weight (out of 256) of the second.
+static void tileBlend(int size, int tiles, int p, int* first, int* second, int* weight) {
+    // Centres sit at (start + end - 1) / 2; doubled to stay in integers.
+    int i = 0;
+    while (i + 1 < tiles && tileStart(size, tiles, i + 1) + tileStart(size, tiles, i + 2) - 1 <= 2 * p) {
+        i++;
     }
-    unsigned int cdf_min = 0;
+    int centre = tileStart(size, tiles, i) + tileStart(size, tiles, i + 1) - 1;
+    if (2 * p <= centre || i + 1 == tiles) {
+        *first = *second = i;
+        *weight = 0;
+        return;
+    }
+    int next = tileStart(size, tiles, i + 1) + tileStart(size, tiles, i + 2) - 1;
+    *first = i;
+    *second = i + 1;
+    *weight = (int)(((long long)(2 * p - centre) * 256 + (next - centre) / 2) / (next - centre));
+}
+
+// Caps every bin at clipLimit times the mean bin count and spreads what was
+// cut off evenly over all bins, which bounds the table's slope.
+static void clipHistogram(unsigned int hist[256], unsigned int count, float clipLimit) {
+    if (clipLimit < 1.0f) return;
+    unsigned int limit = (unsigned int)(clipLimit * count / 256.0f);
+    if (limit < 1) limit = 1;
+
+    unsigned int excess = 0;
     for (int i = 0; i < 256; i++) {
-        if (cdf[i] != 0) {
-            cdf_min = cdf[i];
-            break;
+        if (hist[i] > limit) {
+            excess += hist[i] - limit;
+            hist[i] = limit;
         }
     }
-    unsigned int hist_eq[256];
+    unsigned int share = excess / 256, rest = excess % 256;
     for (int i = 0; i < 256; i++) {
-        hist_eq[i] = round(((float)(cdf[i] - cdf_min) / (size - cdf_min)) * 255);
+        hist[i] += share;
+    }
+    for (unsigned int k = 0; k < rest; k++) {
+        hist[k * 256 / rest]++;
+    }
+}
+
+// Tile histograms of one band of rows, computing the luma rows first for
+// 24-bit images so the pixels are read once for both.
+static void claheCountBand(void* context, int band) {
+    t_claheJob* job = (t_claheJob*)context;
+    const t_view* plane = job->plane;
+    int y0 = tileStart(plane->height, job->bands, band);
+    int y1 = tileStart(plane->height, job->bands, band + 1);
+    unsigned int* partial = job->partial + (size_t)band * job->tilesX * job->tilesY * 256;
+
+    int ty = 0;
+    for (int y = y0; y < y1; y++) {
+        unsigned char* row = view_row(plane, y);
+        if (job->img) {
+            luma_row((const unsigned char*)bmp24_row(job->img, y), job->img->channels, row, plane->width, job->level);
+        }
+        while (tileStart(plane->height, job->tilesY, ty + 1) <= y) ty++;
+        for (int tx = 0; tx < job->tilesX; tx++) {
+            int x0 = tileStart(plane->width, job->tilesX, tx);
+            int x1 = tileStart(plane->width, job->tilesX, tx + 1);
+            histogram_add(row + x0, (size_t)(x1 - x0), partial + ((size_t)ty * job->tilesX + tx) * 256);
+        }
+    }
+}
+
+static void claheTile(void* context, int index) {
+    t_claheJob* job = (t_claheJob*)context;
+    const t_view* plane = job->plane;
+    int tx = index % job->tilesX, ty = index / job->tilesX;
+    int width = tileStart(plane->width, job->tilesX, tx + 1) - tileStart(plane->width, job->tilesX, tx);
+    int height = tileStart(plane->height, job->tilesY, ty + 1) - tileStart(plane->height, job->tilesY, ty);
+    unsigned int count = (unsigned int)width * height;
+
+    unsigned int hist[256] = {0};
+    size_t tiles = (size_t)job->tilesX * job->tilesY;
+    for (int b = 0; b < job->bands; b++) {
+        const unsigned int* partial = job->partial + (b * tiles + index) * 256;
+        for (int i = 0; i < 256; i++) {
+            hist[i] += partial[i];
+        }
     }
+    clipHistogram(hist, count, job->clipLimit);
 
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            int y_int = (int)round(yuv[y][x].y);
-            if (y_int < 0) y_int = 0;
-            if (y_int > 255) y_int = 255;
-            float Y = hist_eq[y_int];
-            float U = yuv[y][x].u;
-            float V = yuv[y][x].v;
+    // A tile of one value has no contrast to stretch (and no CDF range).
+    unsigned char* lut = job->luts + (size_t)index * 256;
+    int bin = 0;
+    while (hist[bin] == 0) bin++;
+    if (hist[bin] == count) {
+        for (int i = 0; i < 256; i++) {
+            lut[i] = (unsigned char)i;
+        }
+        return;
+    }
+    equalize_table(hist, count, lut);
+}
 
-            float r = Y + 1.13983f * V;
-            float g = Y - 0.39465f * U - 0.58060f * V;
-            float b = Y + 2.03211f * U;
+// Maps row y of the plane from in[] to out[], which may be the same. The
+// tables above and below are blended once per row into rowLuts (8.8 fixed
+// point, one per tile column), leaving two lookups per sample.
+static void claheRow(const t_claheJob* job, int y, const unsigned char* in, unsigned char* out,
+                     unsigned short* rowLuts) {
+    int top, bottom, wy;
+    tileBlend(job->plane->height, job->tilesY, y, &top, &bottom, &wy);
+    const unsigned char* upper = job->luts + (size_t)top * job->tilesX * 256;
+    const unsigned char* lower = job->luts + (size_t)bottom * job->tilesX * 256;
+    for (int k = 0; k < job->tilesX * 256; k++) {
+        rowLuts[k] = (unsigned short)(upper[k] * (256 - wy) + lower[k] * wy);
+    }
+
+    for (int x = 0; x < job->plane->width; x++) {
+        int v = in[x];
+        int wx = job->columnWeight[x];
+        unsigned int sum = rowLuts[job->columnLeft[x] + v] * (unsigned int)(256 - wx)
+                         + rowLuts[job->columnRight[x] + v] * (unsigned int)wx;
+        out[x] = (unsigned char)((sum + 32768) >> 16);
+    }
+}
 
-            if (r < 0) r = 0; if (r > 255) r = 255;
-            if (g < 0) g = 0; if (g > 255) g = 255;
-            if (b < 0) b = 0; if (b > 255) b = 255;
+static void claheRows8(void* context, int y0, int y1) {
+    t_claheJob* job = (t_claheJob*)context;
+    unsigned short* rowLuts = (unsigned short*)bufferPool_get((size_t)job->tilesX * 256 * sizeof(unsigned short), 0);
+    if (!rowLuts) return;
+    for (int y = y0; y < y1; y++) {
+        unsigned char* row = view_row(job->plane, y);
+        claheRow(job, y, row, row, rowLuts);
+    }
+    bufferPool_release(rowLuts);
+}
 
-            img->data[y][x].red = (unsigned char)round(r);
-            img->data[y][x].green = (unsigned char)round(g);
-            img->data[y][x].blue = (unsigned char)round(b);
+// As in remapRows24, the luma change is added to every channel.
+static void claheRows24(void* context, int y0, int y1) {
+    t_claheJob* job = (t_claheJob*)context;
+    int w = job->img->width;
+    unsigned short* rowLuts = (unsigned short*)bufferPool_get((size_t)job->tilesX * 256 * sizeof(unsigned short) + w, 0);
+    if (!rowLuts) return;
+    unsigned char* target = (unsigned char*)(rowLuts + (size_t)job->tilesX * 256);
+    for (int y = y0; y < y1; y++) {
+        const unsigned char* luma = view_row(job->plane, y);
+        claheRow(job, y, luma, target, rowLuts);
+        shiftRow((unsigned char*)bmp24_row(job->img, y), job->img->channels, luma, target, w, job->level);
+    }
+    bufferPool_release(rowLuts);
+}
+
+// Counts the tiles (in bands, each into its own histograms, merged in a
+// fixed order) and builds their tables, then remaps the rows.
+static void claheRun(t_claheJob* job, int tilesX, int tilesY, float clipLimit, t_bandFn remap) {
+    const t_view* plane = job->plane;
+    job->tilesX = tilesX < 1 ? 1 : tilesX > plane->width ? plane->width : tilesX;
+    job->tilesY = tilesY < 1 ? 1 : tilesY > plane->height ? plane->height : tilesY;
+    job->clipLimit = clipLimit;
+    job->level = cpu_simdLevel();
+    job->bands = threadPool_bandCount(plane->height, EQUALIZE_ROWS);
+
+    size_t tiles = (size_t)job->tilesX * job->tilesY;
+    job->partial = (unsigned int*)bufferPool_getZeroed(job->bands * tiles * 256 * sizeof(unsigned int), 0);
+    job->luts = (unsigned char*)bufferPool_get(tiles * 256, 0);
+    job->columnLeft = (int*)bufferPool_get(3 * (size_t)plane->width * sizeof(int), 0);
+    if (job->partial && job->luts && job->columnLeft) {
+        job->columnRight = job->columnLeft + plane->width;
+        job->columnWeight = job->columnRight + plane->width;
+        for (int x = 0; x < plane->width; x++) {
+            int left, right;
+            tileBlend(plane->width, job->tilesX, x, &left, &right, &job->columnWeight[x]);
+            job->columnLeft[x] = left * 256;
+            job->columnRight[x] = right * 256;
         }
-        free(yuv[y]);
+
+        threadPool_parallelFor(job->bands, claheCountBand, job);
+        threadPool_parallelFor((int)tiles, claheTile, job);
+        threadPool_forBands(plane->height, EQUALIZE_ROWS, remap, job);
     }
-    free(yuv);
-}
\ No newline at end of file
+    bufferPool_release(job->partial);
+    bufferPool_release(job->luts);
+    bufferPool_release(job->columnLeft);
+}
+
+void bmp8_clahe(t_bmp8* img, int tilesX, int tilesY, float clipLimit) {
+    if (!img || !img->data || img->width == 0 || img->height == 0) return;
+
+    double start = trace_begin();
+    t_view plane = bmp8_view(img);
+    t_claheJob job;
+    job.plane = &plane;
+    job.img = NULL;
+    claheRun(&job, tilesX, tilesY, clipLimit, claheRows8);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_clahe", start);
+}
+
+void bmp24_clahe(t_bmp24* img, int tilesX, int tilesY, float clipLimit) {
+    if (!img || !img->data || img->width <= 0 || img->height <= 0) return;
+
+    double start = trace_begin();
+    unsigned char* luma = (unsigned char*)bufferPool_get((size_t)img->width * img->height, 0);
+    if (!luma) return;
+    t_view plane = { luma, img->width, img->height, img->width, 1 };
+    t_claheJob job;
+    job.plane = &plane;
+    job.img = img;
+    claheRun(&job, tilesX, tilesY, clipLimit, claheRows24);
+    bufferPool_release(luma);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_clahe", start);
+}
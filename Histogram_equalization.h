@@ -4,14 +4,33 @@
 #define HISTOGRAM_EQUALIZATION_H
 
 typedef struct {
-    float y;
-    float u;
-    float v;
-} t_yuv;
+    unsigned int red[256];
+    unsigned int green[256];
+    unsigned int blue[256];
+} t_histogram24;
 
 unsigned int* bmp8_computeHistogram(t_bmp8* img);
+t_histogram24* bmp24_computeHistograms(t_bmp24* img);
 unsigned int* bmp8_computeCDF(unsigned int* hist, unsigned int dataSize);
 void bmp8_equalize(t_bmp8* img);
 void bmp24_equalize(t_bmp24* img);
 
+// Equalization in two steps, for images processed in pieces: accumulate the
+// histogram over every piece (bmp8_computeHistogram or bmp24_addLumaHistogram),
+// build the table for the whole image once, then remap every piece with it.
+void equalize_table(const unsigned int hist[256], unsigned int count, unsigned char lut[256]);
+int bmp24_addLumaHistogram(t_bmp24* img, unsigned int hist[256]);
+void bmp8_equalizeWith(t_bmp8* img, const unsigned char lut[256]);
+void bmp24_equalizeWith(t_bmp24* img, const unsigned char lut[256]);
+
+// Contrast-limited adaptive equalization: the image is cut into tilesX x
+// tilesY tiles, each equalized from its own histogram with every bin capped
+// at clipLimit times the mean bin count (below 1: no cap), and each pixel
+// blends the tables of the four nearest tile centres. 24-bit images work on
+// luma like bmp24_equalize.
+#define CLAHE_TILES 8
+
+void bmp8_clahe(t_bmp8* img, int tilesX, int tilesY, float clipLimit);
+void bmp24_clahe(t_bmp24* img, int tilesX, int tilesY, float clipLimit);
+
 #endif
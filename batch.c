@@ -0,0 +1,164 @@
+#include "batch.h"
+#include "timing.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_IN_FLIGHT 3
+
+// Every stage takes the items in order, so the queues between them are index
+// ranges: [processed, loaded) waits for the worker, [saved, processed) for
+// the writer. Item i lives in slot i % inFlight until it is saved.
+typedef struct {
+    t_batchItem* items;
+    int count;
+    const t_operation* ops;
+    int opCount;
+    int loadFlags;
+    int inFlight;
+    t_batchReportFn report;
+    void* context;
+
+    t_image* slots;
+    double* starts;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int loaded;
+    int processed;
+    int saved;
+    int failed;
+} t_pipeline;
+
+static void advance(t_pipeline* pipe, int* counter) {
+    pthread_mutex_lock(&pipe->lock);
+    (*counter)++;
+    pthread_cond_broadcast(&pipe->changed);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+// Waits until the stage counting in *counter has handed over item index.
+static void waitPast(t_pipeline* pipe, const int* counter, int index) {
+    pthread_mutex_lock(&pipe->lock);
+    while (*counter <= index) {
+        pthread_cond_wait(&pipe->changed, &pipe->lock);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+static void loadItem(t_pipeline* pipe, int i) {
+    // Item i reuses the slot of item i - inFlight, which must be saved first.
+    waitPast(pipe, &pipe->saved, i - pipe->inFlight);
+
+    t_batchItem* item = &pipe->items[i];
+    t_image* image = &pipe->slots[i % pipe->inFlight];
+    pipe->starts[i] = timing_now();
+    double start = trace_begin();
+    if (image_load(image, item->input, pipe->loadFlags) != 0) {
+        snprintf(item->error, sizeof(item->error), "cannot load");
+    }
+    trace_end("batch_load", start);
+    item->loadSeconds = timing_now() - pipe->starts[i];
+    advance(pipe, &pipe->loaded);
+}
+
+static void processItem(t_pipeline* pipe, int i) {
+    waitPast(pipe, &pipe->loaded, i);
+
+    t_batchItem* item = &pipe->items[i];
+    t_image* image = &pipe->slots[i % pipe->inFlight];
+    int failedOp;
+    double begin = timing_now();
+    if (!item->error[0] && op_applyList(image, pipe->ops, pipe->opCount, &failedOp) != 0) {
+        snprintf(item->error, sizeof(item->error), "%s is not available for %s images",
+                 op_name(pipe->ops[failedOp].type), image->gray ? "8-bit" : "24-bit");
+    }
+    item->processSeconds = timing_now() - begin;
+    advance(pipe, &pipe->processed);
+}
+
+static void saveItem(t_pipeline* pipe, int i) {
+    waitPast(pipe, &pipe->processed, i);
+
+    t_batchItem* item = &pipe->items[i];
+    t_image* image = &pipe->slots[i % pipe->inFlight];
+    double begin = timing_now();
+    double start = trace_begin();
+    if (!item->error[0]) {
+        if (image_save(image, item->output) != 0) {
+            snprintf(item->error, sizeof(item->error), "cannot save");
+        } else {
+            item->pixels = (double)image_width(image) * image_height(image);
+        }
+    }
+    image_free(image);
+    trace_end("batch_save", start);
+    double end = timing_now();
+    item->saveSeconds = end - begin;
+    item->seconds = end - pipe->starts[i];
+    if (item->error[0]) pipe->failed++;
+    if (pipe->report) pipe->report(pipe->context, item);
+    advance(pipe, &pipe->saved);
+}
+
+static void* readerStage(void* context) {
+    t_pipeline* pipe = (t_pipeline*)context;
+    for (int i = 0; i < pipe->count; i++) loadItem(pipe, i);
+    return NULL;
+}
+
+static void* writerStage(void* context) {
+    t_pipeline* pipe = (t_pipeline*)context;
+    for (int i = 0; i < pipe->count; i++) saveItem(pipe, i);
+    return NULL;
+}
+
+int batch_run(t_batchItem* items, int count, const t_operation* ops, int opCount,
+              int loadFlags, int inFlight, t_batchReportFn report, void* context) {
+    t_pipeline pipe;
+    pipe.items = items;
+    pipe.count = count;
+    pipe.ops = ops;
+    pipe.opCount = opCount;
+    pipe.loadFlags = loadFlags;
+    pipe.inFlight = inFlight > 0 ? inFlight : DEFAULT_IN_FLIGHT;
+    pipe.report = report;
+    pipe.context = context;
+    pipe.loaded = pipe.processed = pipe.saved = pipe.failed = 0;
+    for (int i = 0; i < count; i++) {
+        items[i].seconds = 0;
+        items[i].loadSeconds = items[i].processSeconds = items[i].saveSeconds = 0;
+        items[i].pixels = 0;
+        items[i].error[0] = '\0';
+    }
+
+    pipe.slots = (t_image*)calloc(pipe.inFlight, sizeof(t_image));
+    pipe.starts = (double*)calloc(count > 0 ? count : 1, sizeof(double));
+    if (!pipe.slots || !pipe.starts) {
+        printf("Error: Memory allocation failed\n");
+        free(pipe.slots);
+        free(pipe.starts);
+        return count;
+    }
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.changed, NULL);
+
+    // Whichever stage thread cannot be started, the calling thread does its
+    // work in step with the processing, one image at a time.
+    pthread_t reader, writer;
+    int writing = pthread_create(&writer, NULL, writerStage, &pipe) == 0;
+    int reading = writing && pthread_create(&reader, NULL, readerStage, &pipe) == 0;
+    for (int i = 0; i < count; i++) {
+        if (!reading) loadItem(&pipe, i);
+        processItem(&pipe, i);
+        if (!writing) saveItem(&pipe, i);
+    }
+    if (reading) pthread_join(reader, NULL);
+    if (writing) pthread_join(writer, NULL);
+
+    pthread_cond_destroy(&pipe.changed);
+    pthread_mutex_destroy(&pipe.lock);
+    free(pipe.starts);
+    free(pipe.slots);
+    return pipe.failed;
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "operations.h"
+
+// One image of a batch and, once it has been through, how it went.
+typedef struct {
+    const char* input;
+    const char* output;
+    double seconds;         // from the start of its load to the end of its save
+    double loadSeconds;     // time spent in each stage
+    double processSeconds;
+    double saveSeconds;
+    double pixels;          // 0 when it failed
+    char error[160];        // empty on success
+} t_batchItem;
+
+typedef void (*t_batchReportFn)(void* context, const t_batchItem* item);
+
+// Loads, processes and saves every item as a pipeline: a reader thread
+// loads, the calling thread applies ops (spreading each over the thread
+// pool), and a writer thread saves, so that disk and CPU work overlap. At
+// most inFlight images are held at once (3, one per stage, when <= 0).
+// Images are loaded with loadFlags (see image_load). report runs on the
+// writer thread, in item order. Returns the number of items that failed.
+int batch_run(t_batchItem* items, int count, const t_operation* ops, int opCount,
+              int loadFlags, int inFlight, t_batchReportFn report, void* context);
+
+#endif
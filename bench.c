@@ -0,0 +1,572 @@
+// Benchmark for the bmp8_ and bmp24_ operations on synthetic images.
+//
+// Build alongside the library sources, without main.c:
+//   cc -O2 -o bench bench.c $(ls *.c | grep -v -e main.c -e bench.c) -lm -lpthread
+//
+// Every operation is timed after warmup runs on a fresh copy of the image;
+// the report gives median and p95 latency, MB/s and Mpixel/s per image size.
+// 24-bit images are timed twice: as loaded (bgr24) and in the BGRX working
+// format (bgrx32, see bmp24_toBGRX), followed by what the conversion costs
+// against what each operation gains from it.
+// -j writes the results as JSON; -b compares them with such a file and exits
+// with status 1 when a median got slower than the allowed tolerance.
+// -k times the built-in 3x3 kernels instead (see conv3x3_reportSpeedups):
+// float, scalar and vector fixed-point, and specialized rows per size.
+
+#include "bmp8.h"
+#include "bmp24.h"
+#include "Histogram_equalization.h"
+#include "conv3x3.h"
+#include "cpu_features.h"
+#include "operations.h"
+#include "thread_pool.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SIZES 16
+#define MAX_RESULTS 1024
+
+typedef struct {
+    int width;
+    int height;
+} t_size;
+
+typedef struct {
+    char name[96];          // "<depth>/<width>x<height>/<operation>"
+    int depth;
+    int width;
+    int height;
+    int runs;
+    double median;          // seconds
+    double p95;
+    double megabytesPerSecond;
+    double megapixelsPerSecond;
+} t_result;
+
+typedef struct {
+    t_size sizes[MAX_SIZES];
+    int sizeCount;
+    int runs;
+    int warmup;
+    const char* only;       // substring filter on result names, or NULL
+    const char* directory;  // where the synthetic files are written
+    const char* jsonPath;
+    const char* baselinePath;
+    double tolerance;       // allowed slowdown against the baseline, as a fraction
+    int kernels;            // report the 3x3 kernel paths instead of the operations
+} t_options;
+
+static t_result results[MAX_RESULTS];
+static int resultCount = 0;
+
+// Deterministic pseudo-random bytes, so runs and machines see the same data.
+static unsigned int nextRandom(unsigned int* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 24;
+}
+
+static void putU16(unsigned char* bytes, unsigned int value) {
+    bytes[0] = (unsigned char)value;
+    bytes[1] = (unsigned char)(value >> 8);
+}
+
+static void putU32(unsigned char* bytes, unsigned int value) {
+    putU16(bytes, value & 0xFFFF);
+    putU16(bytes + 2, value >> 16);
+}
+
+// A gradient with noise, so histograms and filters see realistic content.
+static int writeSynthetic(const char* path, int width, int height, int depth) {
+    int rowSize = ((width * depth / 8) + 3) & ~3;
+    unsigned int offset = 54 + (depth == 8 ? 1024 : 0);
+    unsigned char head[54 + 1024];
+    memset(head, 0, sizeof(head));
+    head[0] = 'B';
+    head[1] = 'M';
+    putU32(head + 2, offset + (unsigned int)rowSize * height);
+    putU32(head + 10, offset);
+    putU32(head + 14, 40);
+    putU32(head + 18, (unsigned int)width);
+    putU32(head + 22, (unsigned int)height);
+    putU16(head + 26, 1);
+    putU16(head + 28, (unsigned int)depth);
+    putU32(head + 34, (unsigned int)rowSize * height);
+    for (int i = 0; depth == 8 && i < 256; i++) {
+        head[54 + 4 * i] = head[55 + 4 * i] = head[56 + 4 * i] = (unsigned char)i;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("Error: Cannot create file %s\n", path);
+        return -1;
+    }
+    unsigned char* row = (unsigned char*)calloc(rowSize, 1);
+    int status = row && fwrite(head, 1, offset, file) == offset ? 0 : -1;
+    unsigned int state = 12345;
+    for (int y = 0; y < height && status == 0; y++) {
+        for (int x = 0; x < width * depth / 8; x++) {
+            int base = (int)((long long)x * 160 / (width * depth / 8) + (long long)y * 80 / height);
+            row[x] = (unsigned char)(base + (nextRandom(&state) & 15));
+        }
+        if (fwrite(row, 1, rowSize, file) != (size_t)rowSize) status = -1;
+    }
+    free(row);
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) printf("Error: Could not write file %s\n", path);
+    return status;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void addResult(const char* depthName, int depth, t_size size, const char* op,
+                      double* times, int runs) {
+    if (resultCount == MAX_RESULTS) return;
+    qsort(times, runs, sizeof(double), compareDoubles);
+
+    t_result* result = &results[resultCount++];
+    snprintf(result->name, sizeof(result->name), "%s/%dx%d/%s", depthName, size.width, size.height, op);
+    result->depth = depth;
+    result->width = size.width;
+    result->height = size.height;
+    result->runs = runs;
+    result->median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    // Nearest-rank percentile.
+    int rank = (95 * runs + 99) / 100;
+    result->p95 = times[(rank > 0 ? rank : 1) - 1];
+
+    double pixels = (double)size.width * size.height;
+    double bytes = pixels * depth / 8;
+    result->megabytesPerSecond = result->median > 0 ? bytes / result->median / 1e6 : 0;
+    result->megapixelsPerSecond = result->median > 0 ? pixels / result->median / 1e6 : 0;
+
+    printf("  %-40s median %9.3f ms  p95 %9.3f ms  %9.1f MB/s  %8.1f Mpix/s\n",
+           result->name, result->median * 1e3, result->p95 * 1e3,
+           result->megabytesPerSecond, result->megapixelsPerSecond);
+    fflush(stdout);
+}
+
+static int selected(const t_options* options, const char* depthName, t_size size, const char* op) {
+    if (!options->only) return 1;
+    char name[96];
+    snprintf(name, sizeof(name), "%s/%dx%d/%s", depthName, size.width, size.height, op);
+    return strstr(name, options->only) != NULL;
+}
+
+// Pixel bytes of the image, lowest row first, for restoring between runs.
+static unsigned char* pixelBytes(const t_image* image, size_t* bytes) {
+    if (image->gray) {
+        *bytes = image->gray->dataSize;
+        return image->gray->data;
+    }
+    t_bmp24* img = image->color;
+    *bytes = (size_t)abs(img->stride) * img->height;
+    return img->stride < 0 ? (unsigned char*)bmp24_row(img, img->height - 1) : img->data;
+}
+
+static void timeLoads(const t_options* options, const char* path, const char* depthName,
+                      int depth, t_size size, int loadFlags, double* times) {
+    for (int mapped = 0; mapped < 2; mapped++) {
+        const char* op = mapped ? "load_mapped" : "load";
+        if (!selected(options, depthName, size, op)) continue;
+        for (int run = -options->warmup; run < options->runs; run++) {
+            t_image image;
+            double start = timing_now();
+            int status = image_load(&image, path, loadFlags | (mapped ? LOAD_MAPPED : 0));
+            double elapsed = timing_now() - start;
+            image_free(&image);
+            if (status != 0) return;
+            if (run >= 0) times[run] = elapsed;
+        }
+        addResult(depthName, depth, size, op, times, options->runs);
+    }
+}
+
+static void timeSave(const t_options* options, const t_image* image, const char* path,
+                     const char* depthName, int depth, t_size size, double* times) {
+    if (!selected(options, depthName, size, "save")) return;
+    for (int run = -options->warmup; run < options->runs; run++) {
+        double start = timing_now();
+        int status = image_save(image, path);
+        double elapsed = timing_now() - start;
+        if (status != 0) return;
+        if (run >= 0) times[run] = elapsed;
+    }
+    remove(path);
+    addResult(depthName, depth, size, "save", times, options->runs);
+}
+
+// Both directions of the BGRX conversion on a BGRX image, which each run
+// leaves as it found it.
+static void timeConversions(const t_options* options, t_bmp24* img, const char* depthName,
+                            int depth, t_size size, double* times) {
+    if (!selected(options, depthName, size, "to_bgrx") && !selected(options, depthName, size, "from_bgrx")) return;
+    double* back = (double*)malloc(options->runs * sizeof(double));
+    if (!back) return;
+    int status = 0;
+    for (int run = -options->warmup; run < options->runs && status == 0; run++) {
+        double start = timing_now();
+        status = bmp24_toBGR24(img);
+        double packed = timing_now();
+        if (status == 0) status = bmp24_toBGRX(img);
+        double end = timing_now();
+        if (run >= 0) {
+            back[run] = packed - start;
+            times[run] = end - packed;
+        }
+    }
+    if (status == 0 && selected(options, depthName, size, "to_bgrx")) {
+        addResult(depthName, depth, size, "to_bgrx", times, options->runs);
+    }
+    if (status == 0 && selected(options, depthName, size, "from_bgrx")) {
+        addResult(depthName, depth, size, "from_bgrx", back, options->runs);
+    }
+    free(back);
+}
+
+// Typical parameters for the operations that take one.
+static float defaultValue(t_opType type) {
+    switch (type) {
+        case OP_BRIGHTNESS: return 40;
+        case OP_THRESHOLD: return 128;
+        case OP_BLUR: return 8;
+        case OP_FAST_GAUSSIAN: return 4;
+        case OP_MEDIAN: return 2;
+        case OP_MIN: return 2;
+        case OP_MAX: return 2;
+        case OP_CLAHE: return 2;
+        default: return 0;
+    }
+}
+
+static void timeOperations(const t_options* options, t_image* work, const unsigned char* pristine,
+                           const char* depthName, int depth, t_size size, double* times) {
+    size_t bytes;
+    unsigned char* pixels = pixelBytes(work, &bytes);
+
+    for (int type = 0; type < OP_COUNT; type++) {
+        t_operation op = { (t_opType)type, defaultValue((t_opType)type) };
+        // Grayscale leaves 8-bit images untouched; there is nothing to time.
+        if (work->gray && op.type == OP_GRAYSCALE) continue;
+        // to_gray8 replaces the image, so it is timed on its own below.
+        if (op.type == OP_TO_GRAY8) continue;
+        if (!selected(options, depthName, size, op_name(op.type))) continue;
+
+        int supported = 1;
+        for (int run = -options->warmup; run < options->runs && supported; run++) {
+            memcpy(pixels, pristine, bytes);
+            double start = timing_now();
+            supported = op_apply(work, &op) == 0;
+            double elapsed = timing_now() - start;
+            if (run >= 0) times[run] = elapsed;
+        }
+        if (supported) addResult(depthName, depth, size, op_name(op.type), times, options->runs);
+    }
+
+    if (selected(options, depthName, size, "histogram")) {
+        for (int run = -options->warmup; run < options->runs; run++) {
+            double start = timing_now();
+            void* hist = work->gray ? (void*)bmp8_computeHistogram(work->gray)
+                                    : (void*)bmp24_computeHistograms(work->color);
+            double elapsed = timing_now() - start;
+            free(hist);
+            if (run >= 0) times[run] = elapsed;
+        }
+        addResult(depthName, depth, size, "histogram", times, options->runs);
+    }
+
+    if (work->color && selected(options, depthName, size, op_name(OP_TO_GRAY8))) {
+        for (int run = -options->warmup; run < options->runs; run++) {
+            double start = timing_now();
+            t_bmp8* gray = bmp24_toGray8(work->color);
+            double elapsed = timing_now() - start;
+            bmp8_free(gray);
+            if (run >= 0) times[run] = elapsed;
+        }
+        addResult(depthName, depth, size, op_name(OP_TO_GRAY8), times, options->runs);
+    }
+}
+
+// Whether the filter leaves anything to time at this size, before writing the file.
+static int anySelected(const t_options* options, const char* depthName, t_size size) {
+    static const char* fixed[] = { "load", "load_mapped", "save", "histogram", "to_bgrx", "from_bgrx" };
+    for (int i = 0; i < 6; i++) {
+        if (selected(options, depthName, size, fixed[i])) return 1;
+    }
+    for (int type = 0; type < OP_COUNT; type++) {
+        if (selected(options, depthName, size, op_name((t_opType)type))) return 1;
+    }
+    return 0;
+}
+
+// bgrx: time 24-bit images in the BGRX working format.
+static void benchSize(const t_options* options, t_size size, int depth, int bgrx) {
+    const char* depthName = depth == 8 ? "gray8" : bgrx ? "bgrx32" : "bgr24";
+    int loadFlags = bgrx ? LOAD_BGRX : 0;
+    if (!anySelected(options, depthName, size)) return;
+    char input[1024], output[1024];
+    snprintf(input, sizeof(input), "%s/bench_input_%d.bmp", options->directory, depth);
+    snprintf(output, sizeof(output), "%s/bench_output_%d.bmp", options->directory, depth);
+
+    printf("%s %dx%d (%.1f Mpixel)\n", depthName, size.width, size.height,
+           (double)size.width * size.height / 1e6);
+    if (writeSynthetic(input, size.width, size.height, depth) != 0) return;
+
+    double* times = (double*)malloc(options->runs * sizeof(double));
+    t_image work;
+    if (!times || image_load(&work, input, loadFlags) != 0) {
+        free(times);
+        remove(input);
+        return;
+    }
+
+    timeLoads(options, input, depthName, depth, size, loadFlags, times);
+    timeSave(options, &work, output, depthName, depth, size, times);
+    if (bgrx) timeConversions(options, work.color, depthName, depth, size, times);
+
+    size_t bytes;
+    unsigned char* pixels = pixelBytes(&work, &bytes);
+    unsigned char* pristine = (unsigned char*)malloc(bytes);
+    if (pristine) {
+        memcpy(pristine, pixels, bytes);
+        timeOperations(options, &work, pristine, depthName, depth, size, times);
+        free(pristine);
+    }
+
+    image_free(&work);
+    free(times);
+    remove(input);
+}
+
+static const t_result* findResult(const char* depthName, int width, int height, const char* op) {
+    char name[96];
+    snprintf(name, sizeof(name), "%s/%dx%d/%s", depthName, width, height, op);
+    for (int i = 0; i < resultCount; i++) {
+        if (strcmp(results[i].name, name) == 0) return &results[i];
+    }
+    return NULL;
+}
+
+// For every size timed in both 24-bit layouts: the conversion there and
+// back, then per operation what BGRX saves (or loses) per run and how many
+// runs of it an image needs before the conversion has paid for itself.
+static void reportWorkingFormat(void) {
+    int printed = 0;
+    for (int i = 0; i < resultCount; i++) {
+        const t_result* r = &results[i];
+        if (strncmp(r->name, "bgrx32/", 7) != 0 || strcmp(strrchr(r->name, '/'), "/to_bgrx") != 0) continue;
+        const t_result* back = findResult("bgrx32", r->width, r->height, "from_bgrx");
+        if (!back) continue;
+        double conversion = r->median + back->median;
+        if (!printed) printf("\nBGRX working format against bgr24:\n");
+        printed = 1;
+        printf("  %dx%d: to_bgrx %.3f ms + from_bgrx %.3f ms = %.3f ms per image\n", r->width, r->height,
+               r->median * 1e3, back->median * 1e3, conversion * 1e3);
+
+        for (int k = 0; k < resultCount; k++) {
+            const t_result* x = &results[k];
+            if (strncmp(x->name, "bgrx32/", 7) != 0 || x->width != r->width || x->height != r->height) continue;
+            const char* op = strrchr(x->name, '/') + 1;
+            if (strcmp(op, "to_bgrx") == 0 || strcmp(op, "from_bgrx") == 0) continue;
+            const t_result* base = findResult("bgr24", x->width, x->height, op);
+            if (!base) continue;
+
+            double saved = base->median - x->median;
+            char verdict[48];
+            // Load and save already include a conversion.
+            if (strncmp(op, "load", 4) == 0 || strcmp(op, "save") == 0) {
+                snprintf(verdict, sizeof(verdict), "conversion included");
+            } else if (saved > 0) {
+                int runs = (int)(conversion / saved);
+                if (runs * saved < conversion) runs++;
+                snprintf(verdict, sizeof(verdict), "pays off after %d run(s)", runs);
+            } else {
+                snprintf(verdict, sizeof(verdict), "never pays off");
+            }
+            printf("    %-16s %9.3f -> %9.3f ms  %+8.3f ms/run  %s\n", op, base->median * 1e3, x->median * 1e3,
+                   -saved * 1e3, verdict);
+        }
+    }
+}
+
+static int writeJson(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Error: Cannot create file %s\n", path);
+        return -1;
+    }
+    fprintf(file, "{\n  \"threads\": %d,\n  \"simd\": \"%s\",\n  \"results\": [\n",
+            threadPool_threadCount(), cpu_simdName(cpu_simdLevel()));
+    for (int i = 0; i < resultCount; i++) {
+        const t_result* r = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"depth\": %d, \"width\": %d, \"height\": %d, \"runs\": %d, "
+                      "\"median_ms\": %.4f, \"p95_ms\": %.4f, \"mb_per_s\": %.2f, \"mpix_per_s\": %.2f}%s\n",
+                r->name, r->depth, r->width, r->height, r->runs, r->median * 1e3, r->p95 * 1e3,
+                r->megabytesPerSecond, r->megapixelsPerSecond, i + 1 < resultCount ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Reads the "name" / "median_ms" pairs of a file written by writeJson and
+// reports every result whose median grew by more than the tolerance.
+// Returns the number of regressions, or -1 when the file cannot be read.
+static int compareBaseline(const char* path, double tolerance) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open baseline %s\n", path);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = (char*)malloc(length + 1);
+    if (!text || fread(text, 1, length, file) != (size_t)length) {
+        printf("Error: Cannot read baseline %s\n", path);
+        free(text);
+        fclose(file);
+        return -1;
+    }
+    text[length] = '\0';
+    fclose(file);
+
+    printf("\nAgainst baseline %s (tolerance %.0f%%):\n", path, tolerance * 100);
+    int regressions = 0, matched = 0;
+    const char* cursor = text;
+    while ((cursor = strstr(cursor, "\"name\": \"")) != NULL) {
+        cursor += strlen("\"name\": \"");
+        const char* end = strchr(cursor, '"');
+        const char* median = strstr(cursor, "\"median_ms\": ");
+        if (!end || !median) break;
+        size_t nameLength = (size_t)(end - cursor);
+        double before = strtod(median + strlen("\"median_ms\": "), NULL);
+
+        for (int i = 0; i < resultCount; i++) {
+            if (strlen(results[i].name) != nameLength || strncmp(results[i].name, cursor, nameLength) != 0) continue;
+            double now = results[i].median * 1e3;
+            double change = before > 0 ? now / before - 1 : 0;
+            int regressed = change > tolerance;
+            printf("  %-40s %9.3f -> %9.3f ms  %+6.1f%%%s\n", results[i].name, before, now,
+                   change * 100, regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+            matched++;
+        }
+        cursor = end;
+    }
+    free(text);
+    printf("%d result(s) compared, %d regression(s)\n", matched, regressions);
+    return regressions;
+}
+
+static int parseSizes(const char* text, t_options* options) {
+    options->sizeCount = 0;
+    while (*text) {
+        int width, height, used;
+        if (sscanf(text, "%dx%d%n", &width, &height, &used) != 2 || width <= 0 || height <= 0) return -1;
+        if (options->sizeCount == MAX_SIZES) return -1;
+        options->sizes[options->sizeCount].width = width;
+        options->sizes[options->sizeCount].height = height;
+        options->sizeCount++;
+        text += used;
+        if (*text == ',') text++;
+        else if (*text) return -1;
+    }
+    return options->sizeCount > 0 ? 0 : -1;
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [-s WxH,...] [-r RUNS] [-w WARMUP] [-f FILTER] [-d DIR] [-t THREADS]\n"
+           "          [-j RESULTS.json] [-b BASELINE.json] [-x TOLERANCE_PERCENT]\n"
+           "       %s -k [-s WxH,...] [-t THREADS]\n\n"
+           "  -s  image sizes (default 512x512,2048x2048,8192x6144,10240x10240)\n"
+           "  -r  timed runs per operation (default 5), -w untimed warmup runs (default 1)\n"
+           "  -f  only results whose name contains FILTER, e.g. bgr24 or /box_blur\n"
+           "  -d  directory for the synthetic files (default .)\n"
+           "  -j  write the results as JSON\n"
+           "  -b  compare medians with a JSON file from -j; exit status 1 on regressions\n"
+           "  -x  allowed slowdown against the baseline in percent (default 10)\n"
+           "  -k  time each built-in 3x3 kernel on the float, scalar fixed-point, vector\n"
+           "      fixed-point and specialized paths instead (default size 2048x2048)\n", program, program);
+}
+
+int main(int argc, char** argv) {
+    t_options options;
+    memset(&options, 0, sizeof(options));
+    options.runs = 5;
+    options.warmup = 1;
+    options.directory = ".";
+    options.tolerance = 0.10;
+    parseSizes("512x512,2048x2048,8192x6144,10240x10240", &options);
+    int sizesGiven = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-k") == 0) {
+            options.kernels = 1;
+            continue;
+        }
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 || !value) {
+            printUsage(argv[0]);
+            return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 2;
+        }
+        i++;
+        if (strcmp(arg, "-s") == 0) {
+            if (parseSizes(value, &options) != 0) {
+                printf("Error: Bad size list %s\n", value);
+                return 2;
+            }
+            sizesGiven = 1;
+        } else if (strcmp(arg, "-r") == 0) {
+            options.runs = atoi(value);
+        } else if (strcmp(arg, "-w") == 0) {
+            options.warmup = atoi(value);
+        } else if (strcmp(arg, "-f") == 0) {
+            options.only = value;
+        } else if (strcmp(arg, "-d") == 0) {
+            options.directory = value;
+        } else if (strcmp(arg, "-t") == 0) {
+            threadPool_setThreadCount(atoi(value));
+        } else if (strcmp(arg, "-j") == 0) {
+            options.jsonPath = value;
+        } else if (strcmp(arg, "-b") == 0) {
+            options.baselinePath = value;
+        } else if (strcmp(arg, "-x") == 0) {
+            options.tolerance = atof(value) / 100;
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.runs < 1) options.runs = 1;
+    if (options.warmup < 0) options.warmup = 0;
+
+    if (options.kernels) {
+        if (!sizesGiven) parseSizes("2048x2048", &options);
+        for (int s = 0; s < options.sizeCount; s++) {
+            conv3x3_reportSpeedups(stdout, options.sizes[s].width, options.sizes[s].height);
+        }
+        return 0;
+    }
+
+    printf("threads %d, simd %s, %d run(s) after %d warmup\n",
+           threadPool_threadCount(), cpu_simdName(cpu_simdLevel()), options.runs, options.warmup);
+    for (int s = 0; s < options.sizeCount; s++) {
+        benchSize(&options, options.sizes[s], 8, 0);
+        benchSize(&options, options.sizes[s], 24, 0);
+        benchSize(&options, options.sizes[s], 24, 1);
+    }
+    reportWorkingFormat();
+
+    if (options.jsonPath && writeJson(options.jsonPath) != 0) return 2;
+    if (options.baselinePath) {
+        int regressions = compareBaseline(options.baselinePath, options.tolerance);
+        if (regressions < 0) return 2;
+        if (regressions > 0) return 1;
+    }
+    return 0;
+}
@@ -1,6 +1,33 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "bmp24.h"
+#include "buffer_pool.h"
+#include "cpu_features.h"
+#include "file_map.h"
+#include "convolution.h"
+#include "conv3x3.h"
+#include "kernel_registry.h"
+#include "pixel_format.h"
+#include "luma.h"
+#include "rank_filter.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
 void file_readdata(unsigned int position, void* buffer, unsigned int size, size_t n, FILE* file) {
     fseek(file, position, SEEK_SET);
     fread(buffer, size, n, file);
@@ -11,19 +38,263 @@ void file_writedata(unsigned int position, void* buffer, unsigned int size, size
     fwrite(buffer, size, n, file);
 }
 
-t_pixel** allocatePixelData(int width, int height) {
-    t_pixel** data = (t_pixel**)malloc(height * sizeof(t_pixel*));
-    for (int i = 0; i < height; i++) {
-        data[i] = (t_pixel*)malloc(width * sizeof(t_pixel));
+static void unpackHeader(t_bmp24* img, const unsigned char* raw) {
+    memcpy(&img->header.type, raw + BITMAP_MAGIC, sizeof(unsigned short));
+    memcpy(&img->header.size, raw + BITMAP_SIZE, sizeof(unsigned int));
+    memcpy(&img->header.offset, raw + BITMAP_OFFSET, sizeof(unsigned int));
+    memcpy(&img->header_info, raw + HEADER_SIZE, sizeof(t_bmp_info));
+}
+
+static void packHeader(const t_bmp24* img, unsigned char* raw) {
+    memset(raw, 0, HEADER_SIZE);
+    memcpy(raw + BITMAP_MAGIC, &img->header.type, sizeof(unsigned short));
+    memcpy(raw + BITMAP_SIZE, &img->header.size, sizeof(unsigned int));
+    memcpy(raw + BITMAP_OFFSET, &img->header.offset, sizeof(unsigned int));
+    memcpy(raw + HEADER_SIZE, &img->header_info, sizeof(t_bmp_info));
+}
+
+// Row padding is not touched by the filters; keep the bytes written out zero.
+// (BGRX images have none: their rows are padded as they are packed.)
+static void clearPadding(t_bmp24* img) {
+    int rowSize = bmp24_rowSize(img->width);
+    int padding = rowSize - img->width * 3;
+    if (padding == 0) return;
+    for (int y = 0; y < img->height; y++) {
+        memset((unsigned char*)bmp24_row(img, y) + img->width * 3, 0, padding);
+    }
+}
+
+// Writes both blocks back to back; on POSIX a single writev() covers the whole file.
+static int writeBlocks(FILE* file, const void* head, size_t headSize, const void* body, size_t bodySize) {
+#ifndef _WIN32
+    struct iovec iov[2] = {
+        { (void*)head, headSize },
+        { (void*)body, bodySize }
+    };
+    struct iovec* next = iov;
+    int count = 2;
+    int fd = fileno(file);
+    while (count > 0) {
+        ssize_t written = writev(fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = (char*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+    return 0;
+#else
+    if (fwrite(head, 1, headSize, file) != headSize) return -1;
+    if (fwrite(body, 1, bodySize, file) != bodySize) return -1;
+    return 0;
+#endif
+}
+
+// Pixel arrays come from the buffer pool, so a batch reuses one image's
+// memory for the next instead of faulting in fresh pages.
+unsigned char* allocatePixelData(int rowSize, int height) {
+    return (unsigned char*)bufferPool_get((size_t)rowSize * height, PIXEL_ALIGNMENT);
+}
+
+void freePixelData(unsigned char* buffer) {
+    bufferPool_release(buffer);
+}
+
+// Points data/stride at a pixel array stored in file order.
+static void setPixelArray(t_bmp24* img, unsigned char* pixels) {
+    int rowSize = bmp24_rowSize(img->width);
+    // A negative height in the header marks a top-down file.
+    if (img->header_info.height < 0) {
+        img->stride = rowSize;
+        img->data = pixels;
+    } else {
+        img->stride = -rowSize;
+        img->data = pixels + (size_t)(img->height - 1) * rowSize;
+    }
+}
+
+// Lowest-addressed row of the pixel array, i.e. the first row stored in the file.
+static unsigned char* pixelArray(const t_bmp24* img) {
+    return img->stride < 0 ? img->data + (ptrdiff_t)(img->height - 1) * img->stride : img->data;
+}
+
+static void releasePixels(t_bmp24* img) {
+    if (img->mapping) {
+        file_unmap(img->mapping, img->mappingSize);
+    } else if (img->buffer) {
+        freePixelData(img->buffer);
+    }
+    img->buffer = NULL;
+    img->mapping = NULL;
+    img->mappingSize = 0;
+}
+
+// Conversions between file rows (packed BGR) and BGRX rows.
+static void expandScalar(const unsigned char* in, unsigned char* out, int count) {
+    for (int x = 0; x < count; x++) {
+        out[4 * x] = in[3 * x];
+        out[4 * x + 1] = in[3 * x + 1];
+        out[4 * x + 2] = in[3 * x + 2];
+        out[4 * x + 3] = 0;
+    }
+}
+
+static void packScalar(const unsigned char* in, unsigned char* out, int count) {
+    for (int x = 0; x < count; x++) {
+        out[3 * x] = in[4 * x];
+        out[3 * x + 1] = in[4 * x + 1];
+        out[3 * x + 2] = in[4 * x + 2];
+    }
+}
+
+#ifdef CPU_X86
+
+// 16 bytes hold 5 BGR pixels, of which 4 are spread per step; the loads and
+// (overlapping) stores stay within count pixels.
+TARGET_SSSE3 static void expandSSSE3(const unsigned char* in, unsigned char* out, int count) {
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+    int x = 0;
+    for (; x + 6 <= count; x += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(in + 3 * x));
+        _mm_storeu_si128((__m128i*)(out + 4 * x), _mm_shuffle_epi8(px, spread));
+    }
+    expandScalar(in + 3 * x, out + 4 * x, count - x);
+}
+
+TARGET_SSSE3 static void packSSSE3(const unsigned char* in, unsigned char* out, int count) {
+    const __m128i gather = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+    int x = 0;
+    for (; x + 6 <= count; x += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(in + 4 * x));
+        _mm_storeu_si128((__m128i*)(out + 3 * x), _mm_shuffle_epi8(px, gather));
+    }
+    packScalar(in + 4 * x, out + 3 * x, count - x);
+}
+
+#endif
+
+static void expandRow(const unsigned char* in, unsigned char* out, int count, t_simdLevel level) {
+#ifdef CPU_X86
+    if (level >= SIMD_SSSE3) {
+        expandSSSE3(in, out, count);
+        return;
+    }
+#endif
+    (void)level;
+    expandScalar(in, out, count);
+}
+
+static void packRow(const unsigned char* in, unsigned char* out, int count, t_simdLevel level) {
+#ifdef CPU_X86
+    if (level >= SIMD_SSSE3) {
+        packSSSE3(in, out, count);
+        return;
+    }
+#endif
+    (void)level;
+    packScalar(in, out, count);
+}
+
+// Converting runs in bands of at least CONVERT_ROWS rows, like grayscale.
+#define CONVERT_ROWS 16
+
+typedef struct {
+    const t_bmp24* img;
+    unsigned char* rows;    // the other layout: BGRX rows top-down, or file rows in file order
+    t_simdLevel level;
+} t_convertJob;
+
+// File row of image row y, counted from the start of the pixel array.
+static int fileRow(const t_bmp24* img, int y) {
+    return img->header_info.height < 0 ? y : img->height - 1 - y;
+}
+
+static void expandRows(void* context, int y0, int y1) {
+    t_convertJob* job = (t_convertJob*)context;
+    const t_bmp24* img = job->img;
+    for (int y = y0; y < y1; y++) {
+        const unsigned char* in = (const unsigned char*)bmp24_row(img, y);
+        expandRow(in, job->rows + (size_t)y * img->width * PIXEL_BGRX32, img->width, job->level);
+    }
+}
+
+static void packRows(void* context, int y0, int y1) {
+    t_convertJob* job = (t_convertJob*)context;
+    const t_bmp24* img = job->img;
+    int rowSize = bmp24_rowSize(img->width);
+    for (int y = y0; y < y1; y++) {
+        const unsigned char* in = (const unsigned char*)bmp24_row(img, y);
+        unsigned char* out = job->rows + (size_t)fileRow(img, y) * rowSize;
+        packRow(in, out, img->width, job->level);
+        memset(out + img->width * 3, 0, rowSize - img->width * 3);
+    }
+}
+
+// The pixel array as the file stores it: the image's own block, or for BGRX
+// images a packed copy (*copied set) to release with freePixelData.
+static unsigned char* fileRows(t_bmp24* img, int* copied) {
+    *copied = img->channels == PIXEL_BGRX32;
+    if (!*copied) {
+        clearPadding(img);
+        return pixelArray(img);
     }
-    return data;
+    unsigned char* rows = allocatePixelData(bmp24_rowSize(img->width), img->height);
+    if (!rows) return NULL;
+    t_convertJob job = { img, rows, cpu_simdLevel() };
+    threadPool_forBands(img->height, CONVERT_ROWS, packRows, &job);
+    return rows;
 }
 
-void freePixelData(t_pixel** data, int height) {
-    for (int i = 0; i < height; i++) {
-        free(data[i]);
+int bmp24_toBGRX(t_bmp24* img) {
+    if (!img || !img->data) return -1;
+    if (img->channels == PIXEL_BGRX32) return 0;
+
+    double start = trace_begin();
+    size_t rowLen = (size_t)img->width * PIXEL_BGRX32;
+    unsigned char* rows = (unsigned char*)bufferPool_get(rowLen * img->height, PIXEL_ALIGNMENT);
+    if (!rows) {
+        printf("Error: Memory allocation failed for image data\n");
+        return -1;
+    }
+    t_convertJob job = { img, rows, cpu_simdLevel() };
+    threadPool_forBands(img->height, CONVERT_ROWS, expandRows, &job);
+
+    releasePixels(img);
+    img->buffer = rows;
+    img->data = rows;
+    img->stride = (int)rowLen;
+    img->channels = PIXEL_BGRX32;
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_toBGRX", start);
+    return 0;
+}
+
+int bmp24_toBGR24(t_bmp24* img) {
+    if (!img || !img->data) return -1;
+    if (img->channels == PIXEL_BGR24) return 0;
+
+    double start = trace_begin();
+    int copied;
+    unsigned char* rows = fileRows(img, &copied);
+    if (!rows) {
+        printf("Error: Memory allocation failed for image data\n");
+        return -1;
     }
-    free(data);
+    releasePixels(img);
+    img->buffer = rows;
+    img->channels = PIXEL_BGR24;
+    setPixelArray(img, rows);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_toBGR24", start);
+    return 0;
 }
 
 float** allocateKernel24(int size) {
@@ -41,78 +312,224 @@ void freeKernel24(float** kernel, int size) {
     free(kernel);
 }
 
-t_bmp24* bmp24_loadImage(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        printf("Error: Cannot open file %s\n", filename);
-        return NULL;
+// Rejects dimensions that no pixel array can have before anything is sized
+// from them: rows must fit an int in either layout (BGRX being the wider),
+// INT_MIN has no absolute value, and the array must be a size the buffer
+// pool hands out. Returns the pixel array's size in the file, or 0.
+static size_t pixelArraySize(const t_bmp_info* info) {
+    int width = info->width, height = info->height;
+    if (width <= 0 || width > (INT_MAX - 3) / PIXEL_BGRX32 || height == 0 || height == INT_MIN) {
+        printf("Error: Invalid BMP file format\n");
+        return 0;
     }
+    if (height < 0) height = -height;
+    if ((size_t)width * PIXEL_BGRX32 > SIZE_MAX / 2 / (size_t)height) {
+        printf("Error: Image too large\n");
+        return 0;
+    }
+    return (size_t)bmp24_rowSize(width) * height;
+}
 
+// Continues a file whose first HEADER_SIZE + INFO_SIZE bytes have been read
+// into header; the pixel array is read from the header's offset. The caller
+// keeps the file.
+t_bmp24* bmp24_readImage(FILE* file, const unsigned char* header) {
+    double start = trace_begin();
     t_bmp24* img = (t_bmp24*)malloc(sizeof(t_bmp24));
     if (!img) {
-        fclose(file);
         printf("Error: Memory allocation failed\n");
         return NULL;
     }
 
-    file_readdata(BITMAP_MAGIC, &img->header.type, sizeof(unsigned short), 1, file);
+    unpackHeader(img, header);
     if (img->header.type != BMP_TYPE) {
         printf("Error: Not a BMP file\n");
         free(img);
-        fclose(file);
         return NULL;
     }
 
-    file_readdata(BITMAP_SIZE, &img->header.size, sizeof(unsigned int), 1, file);
-    file_readdata(BITMAP_OFFSET, &img->header.offset, sizeof(unsigned int), 1, file);
-    file_readdata(HEADER_SIZE, &img->header_info, sizeof(t_bmp_info), 1, file);
     img->width = img->header_info.width;
-    img->height = img->header_info.height;
     img->colorDepth = img->header_info.bits;
+    img->channels = PIXEL_BGR24;
     if (img->colorDepth != 24) {
         printf("Error: Image must be 24-bit color\n");
         free(img);
-        fclose(file);
+        return NULL;
+    }
+    size_t pixelBytes = pixelArraySize(&img->header_info);
+    if (pixelBytes == 0) {
+        free(img);
+        return NULL;
+    }
+    img->height = abs(img->header_info.height);
+
+    // A header promising more pixels than the file holds fails before the
+    // allocation, not after it.
+    long fileSize = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (fileSize < 0 || img->header.offset > (unsigned long)fileSize ||
+        pixelBytes > (unsigned long)fileSize - img->header.offset) {
+        printf("Error: Could not read image data\n");
+        free(img);
         return NULL;
     }
 
-    img->data = allocatePixelData(img->width, img->height);
-    if (!img->data) {
+    img->buffer = allocatePixelData(bmp24_rowSize(img->width), img->height);
+    if (!img->buffer) {
         printf("Error: Memory allocation failed for image data\n");
         free(img);
-        fclose(file);
         return NULL;
     }
+    img->mapping = NULL;
+    img->mappingSize = 0;
+    setPixelArray(img, img->buffer);
 
-    bmp24_readPixelData(img, file);
+    if (bmp24_readPixelData(img, file) != 0) {
+        printf("Error: Could not read image data\n");
+        freePixelData(img->buffer);
+        free(img);
+        return NULL;
+    }
+
+    trace_add(TRACE_BYTES_READ, HEADER_SIZE + INFO_SIZE + (uint64_t)bmp24_rowSize(img->width) * img->height);
+    trace_end("bmp24_readImage", start);
+    return img;
+}
 
+// Takes ownership of a mapping from file_map, which is released on failure.
+// Pages come in as the pixels are touched; the whole mapping counts as read.
+t_bmp24* bmp24_fromMapping(void* mapping, size_t size) {
+    unsigned char* map = (unsigned char*)mapping;
+    t_bmp24* img = (t_bmp24*)malloc(sizeof(t_bmp24));
+    if (!img) {
+        file_unmap(map, size);
+        printf("Error: Memory allocation failed\n");
+        return NULL;
+    }
+
+    if (size < HEADER_SIZE + INFO_SIZE) {
+        printf("Error: Not a BMP file\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+    unpackHeader(img, map);
+    if (img->header.type != BMP_TYPE) {
+        printf("Error: Not a BMP file\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+
+    img->width = img->header_info.width;
+    img->colorDepth = img->header_info.bits;
+    img->channels = PIXEL_BGR24;
+    if (img->colorDepth != 24) {
+        printf("Error: Image must be 24-bit color\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+    size_t pixelBytes = pixelArraySize(&img->header_info);
+    if (pixelBytes == 0) {
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+    img->height = abs(img->header_info.height);
+
+    if (img->header.offset > size || pixelBytes > size - img->header.offset) {
+        printf("Error: Could not read image data\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+
+    img->buffer = NULL;
+    img->mapping = map;
+    img->mappingSize = size;
+    setPixelArray(img, map + img->header.offset);
+    trace_add(TRACE_BYTES_READ, size);
+    return img;
+}
+
+t_bmp24* bmp24_loadImage(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+
+    // Unbuffered: the header and the pixel array each come in with one read().
+    setvbuf(file, NULL, _IONBF, 0);
+
+    double start = trace_begin();
+    unsigned char raw[HEADER_SIZE + INFO_SIZE];
+    t_bmp24* img = NULL;
+    if (fread(raw, 1, sizeof(raw), file) != sizeof(raw)) {
+        printf("Error: Not a BMP file\n");
+    } else {
+        img = bmp24_readImage(file, raw);
+    }
     fclose(file);
+    trace_end("bmp24_loadImage", start);
     return img;
 }
 
-void bmp24_saveImage(const char* filename, t_bmp24* img) {
-    if (!img) return;
+t_bmp24* bmp24_loadImageMapped(const char* filename) {
+    size_t size = 0;
+    void* map = file_map(filename, &size);
+    if (!map) {
+        printf("Error: Cannot map file %s\n", filename);
+        return NULL;
+    }
+
+    double start = trace_begin();
+    t_bmp24* img = bmp24_fromMapping(map, size);
+    trace_end("bmp24_loadImageMapped", start);
+    return img;
+}
+
+int bmp24_saveImage(const char* filename, t_bmp24* img) {
+    if (!img) return -1;
+    double start = trace_begin();
 
     FILE* file = fopen(filename, "wb");
     if (!file) {
         printf("Error: Cannot create file %s\n", filename);
-        return;
+        return -1;
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+
+    // Header, zero gap up to the pixel offset, then the pixel array as stored.
+    size_t headSize = img->header.offset > HEADER_SIZE + INFO_SIZE ? img->header.offset : HEADER_SIZE + INFO_SIZE;
+    unsigned char* head = (unsigned char*)calloc(headSize, 1);
+    if (!head) {
+        printf("Error: Memory allocation failed\n");
+        fclose(file);
+        return -1;
     }
+    packHeader(img, head);
 
-    file_writedata(BITMAP_MAGIC, &img->header.type, sizeof(unsigned short), 1, file);
-    file_writedata(BITMAP_SIZE, &img->header.size, sizeof(unsigned int), 1, file);
-    file_writedata(BITMAP_OFFSET, &img->header.offset, sizeof(unsigned int), 1, file);
-    file_writedata(HEADER_SIZE, &img->header_info, sizeof(t_bmp_info), 1, file);
-    bmp24_writePixelData(img, file);
+    int rowSize = bmp24_rowSize(img->width);
+    int copied;
+    unsigned char* rows = fileRows(img, &copied);
 
-    fclose(file);
+    int status = rows ? writeBlocks(file, head, headSize, rows, (size_t)rowSize * img->height) : -1;
+    if (status != 0) {
+        printf("Error: Could not write file %s\n", filename);
+    }
+
+    if (copied) freePixelData(rows);
+    free(head);
+    if (fclose(file) != 0) status = -1;
+    if (status == 0) trace_add(TRACE_BYTES_WRITTEN, headSize + (uint64_t)rowSize * img->height);
+    trace_end("bmp24_saveImage", start);
+    return status;
 }
 
 void bmp24_free(t_bmp24* img) {
     if (img) {
-        if (img->data) {
-            freePixelData(img->data, img->height);
-        }
+        releasePixels(img);
         free(img);
     }
 }
@@ -127,104 +544,209 @@ void bmp24_printInfo(t_bmp24* img) {
     printf("  Data Size: %u\n", img->header_info.imageSize);
 }
 
+// Where pixel (x, y) is stored in the file.
+static unsigned int filePosition(const t_bmp24* img, int x, int y) {
+    return img->header.offset + (unsigned int)fileRow(img, y) * bmp24_rowSize(img->width) + 3 * (unsigned int)x;
+}
+
 void bmp24_readPixelValue(t_bmp24* img, int x, int y, FILE* file) {
     if (!img || !file) return;
 
-    unsigned int position = img->header.offset + ((img->height - 1 - y) * img->width + x) * 3;
-
-    file_readdata(position, &img->data[y][x], sizeof(t_pixel), 1, file);
+    unsigned char* pixel = (unsigned char*)bmp24_pixel(img, x, y);
+    file_readdata(filePosition(img, x, y), pixel, sizeof(t_pixel), 1, file);
 }
 
 void bmp24_writePixelValue(t_bmp24* img, int x, int y, FILE* file) {
     if (!img || !file) return;
-    unsigned int position = img->header.offset + ((img->height - 1 - y) * img->width + x) * 3;
-    file_writedata(position, &img->data[y][x], sizeof(t_pixel), 1, file);
+    unsigned char* pixel = (unsigned char*)bmp24_pixel(img, x, y);
+    file_writedata(filePosition(img, x, y), pixel, sizeof(t_pixel), 1, file);
 }
 
-void bmp24_readPixelData(t_bmp24* img, FILE* file) {
-    if (!img || !file) return;
-    int rowSize = ((img->width * 3 + 3) / 4) * 4;
-    unsigned char* rowBuffer = (unsigned char*)malloc(rowSize);
+int bmp24_readPixelData(t_bmp24* img, FILE* file) {
+    if (!img || !file) return -1;
+    size_t size = (size_t)bmp24_rowSize(img->width) * img->height;
+
+    // The file stores rows in the same bottom-up order as the buffer: one read, no per-row seeks.
+    if (fseek(file, img->header.offset, SEEK_SET) != 0) return -1;
+    if (img->channels == PIXEL_BGR24) return fread(pixelArray(img), 1, size, file) == size ? 0 : -1;
+
+    // BGRX images read into the file layout and spread from there.
+    t_bmp24 packed = *img;
+    packed.buffer = allocatePixelData(bmp24_rowSize(img->width), img->height);
+    packed.mapping = NULL;
+    packed.channels = PIXEL_BGR24;
+    if (!packed.buffer) return -1;
+    setPixelArray(&packed, packed.buffer);
+    int status = fread(packed.buffer, 1, size, file) == size ? 0 : -1;
+    if (status == 0) {
+        t_convertJob job = { &packed, img->data, cpu_simdLevel() };
+        threadPool_forBands(img->height, CONVERT_ROWS, expandRows, &job);
+    }
+    freePixelData(packed.buffer);
+    return status;
+}
 
-    for (int y = 0; y < img->height; y++) {
-        unsigned int position = img->header.offset + (img->height - 1 - y) * rowSize;
-        file_readdata(position, rowBuffer, 1, rowSize, file);
-        for (int x = 0; x < img->width; x++) {
-            img->data[y][x].blue = rowBuffer[x * 3];
-            img->data[y][x].green = rowBuffer[x * 3 + 1];
-            img->data[y][x].red = rowBuffer[x * 3 + 2];
+int bmp24_writePixelData(t_bmp24* img, FILE* file) {
+    if (!img || !file) return -1;
+    int rowSize = bmp24_rowSize(img->width);
+    int copied;
+    unsigned char* rows = fileRows(img, &copied);
+    if (!rows) return -1;
+
+    size_t size = (size_t)rowSize * img->height;
+    int status = fseek(file, img->header.offset, SEEK_SET) == 0 && fwrite(rows, 1, size, file) == size ? 0 : -1;
+    if (copied) freePixelData(rows);
+    return status;
+}
+
+// Grayscale mixes channels, so it runs on its own in bands of at least
+// GRAYSCALE_ROWS rows; the other point operations fold into one lookup table.
+#define GRAYSCALE_ROWS 16
+
+static void grayScalar(unsigned char* pixels, int channels, int count) {
+    for (int x = 0; x < count; x++) {
+        unsigned char* px = pixels + channels * x;
+        unsigned char gray = (px[0] + px[1] + px[2]) / 3;
+        px[0] = gray;
+        px[1] = gray;
+        px[2] = gray;
+    }
+}
+
+#ifdef CPU_X86
+
+// BGRX only: one multiply-add and a horizontal add sum each pixel's three
+// samples, and (sum * 21846) >> 16 equals sum / 3 for every sum up to 765.
+// The unused byte comes out zero.
+TARGET_SSSE3 static void grayBGRXSSSE3(unsigned char* pixels, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i samples = _mm_setr_epi16(1, 1, 1, 0, 1, 1, 1, 0);
+    const __m128i third = _mm_set1_epi16(21846);
+    const __m128i spreadLow = _mm_setr_epi8(0, 0, 0, -128, 1, 1, 1, -128, 2, 2, 2, -128, 3, 3, 3, -128);
+    const __m128i spreadHigh = _mm_setr_epi8(4, 4, 4, -128, 5, 5, 5, -128, 6, 6, 6, -128, 7, 7, 7, -128);
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        unsigned char* px = pixels + 4 * x;
+        __m128i sums[2];
+        for (int v = 0; v < 2; v++) {
+            __m128i value = _mm_loadu_si128((const __m128i*)(px + 16 * v));
+            __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(value, zero), samples);
+            __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(value, zero), samples);
+            sums[v] = _mm_hadd_epi32(low, high);
         }
+        __m128i gray = _mm_mulhi_epu16(_mm_packs_epi32(sums[0], sums[1]), third);
+        gray = _mm_packus_epi16(gray, gray);
+        _mm_storeu_si128((__m128i*)px, _mm_shuffle_epi8(gray, spreadLow));
+        _mm_storeu_si128((__m128i*)(px + 16), _mm_shuffle_epi8(gray, spreadHigh));
     }
-    free(rowBuffer);
+    grayScalar(pixels + 4 * x, PIXEL_BGRX32, count - x);
 }
-void bmp24_writePixelData(t_bmp24* img, FILE* file) {
-    if (!img || !file) return;
-    int rowSize = ((img->width * 3 + 3) / 4) * 4;
-    unsigned char* rowBuffer = (unsigned char*)malloc(rowSize);
-    for (int y = 0; y < img->height; y++) {
-        memset(rowBuffer, 0, rowSize);
-        for (int x = 0; x < img->width; x++) {
-            rowBuffer[x * 3] = img->data[y][x].blue;
-            rowBuffer[x * 3 + 1] = img->data[y][x].green;
-            rowBuffer[x * 3 + 2] = img->data[y][x].red;
+
+#endif
+
+static void grayscaleRows(void* context, int y0, int y1) {
+    t_bmp24* img = (t_bmp24*)context;
+#ifdef CPU_X86
+    if (img->channels == PIXEL_BGRX32 && cpu_simdLevel() >= SIMD_SSSE3) {
+        for (int y = y0; y < y1; y++) {
+            grayBGRXSSSE3((unsigned char*)bmp24_row(img, y), img->width);
         }
-        unsigned int position = img->header.offset + (img->height - 1 - y) * rowSize;
-        file_writedata(position, rowBuffer, 1, rowSize, file);
+        return;
     }
+#endif
+    for (int y = y0; y < y1; y++) {
+        grayScalar((unsigned char*)bmp24_row(img, y), img->channels, img->width);
+    }
+}
+
+void bmp24_applyPointOps(t_bmp24* img, const t_pointOps* ops) {
+    if (!img || !img->data) return;
 
-    free(rowBuffer);
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    pointOps_apply(ops, &view);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_applyPointOps", start);
 }
 
 void bmp24_negative(t_bmp24* img) {
-    if (!img || !img->data) return;
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            img->data[y][x].red = 255 - img->data[y][x].red;
-            img->data[y][x].green = 255 - img->data[y][x].green;
-            img->data[y][x].blue = 255 - img->data[y][x].blue;
-        }
-    }
+    t_pointOps ops;
+    pointOps_init(&ops);
+    pointOps_negative(&ops);
+    bmp24_applyPointOps(img, &ops);
 }
+
 void bmp24_grayscale(t_bmp24* img) {
     if (!img || !img->data) return;
 
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            unsigned char gray = (img->data[y][x].red + img->data[y][x].green + img->data[y][x].blue) / 3;
-            img->data[y][x].red = gray;
-            img->data[y][x].green = gray;
-            img->data[y][x].blue = gray;
-        }
+    double start = trace_begin();
+    threadPool_forBands(img->height, GRAYSCALE_ROWS, grayscaleRows, img);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_grayscale", start);
+}
+
+typedef struct {
+    const t_bmp24* img;
+    t_bmp8* gray;
+    t_simdLevel level;
+} t_toGrayJob;
+
+// Image row y lands in file row height - 1 - y of the bottom-up 8-bit image.
+static void toGrayRows(void* context, int y0, int y1) {
+    t_toGrayJob* job = (t_toGrayJob*)context;
+    const t_bmp24* img = job->img;
+    size_t stride = job->gray->stride;
+    for (int y = y0; y < y1; y++) {
+        unsigned char* out = job->gray->data + (size_t)(img->height - 1 - y) * stride;
+        luma_row((const unsigned char*)bmp24_row(img, y), img->channels, out, img->width, job->level);
+        memset(out + img->width, 0, stride - img->width);
     }
 }
+
+t_bmp8* bmp24_toGray8(const t_bmp24* img) {
+    if (!img || !img->data || img->width <= 0 || img->height <= 0) return NULL;
+
+    double start = trace_begin();
+    t_bmp8* gray = bmp8_create((unsigned int)img->width, (unsigned int)img->height);
+    if (!gray) return NULL;
+    memcpy(&gray->header[38], &img->header_info.xpixels, 4);
+    memcpy(&gray->header[42], &img->header_info.ypixels, 4);
+
+    t_toGrayJob job = { img, gray, cpu_simdLevel() };
+    threadPool_forBands(img->height, GRAYSCALE_ROWS, toGrayRows, &job);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_toGray8", start);
+    return gray;
+}
+
 void bmp24_brightness(t_bmp24* img, int value) {
-    if (!img || !img->data) return;
+    t_pointOps ops;
+    pointOps_init(&ops);
+    pointOps_brightness(&ops, value);
+    bmp24_applyPointOps(img, &ops);
+}
 
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            int red = img->data[y][x].red + value;
-            int green = img->data[y][x].green + value;
-            int blue = img->data[y][x].blue + value;
-
-            img->data[y][x].red = (red > 255) ? 255 : (red < 0) ? 0 : red;
-            img->data[y][x].green = (green > 255) ? 255 : (green < 0) ? 0 : green;
-            img->data[y][x].blue = (blue > 255) ? 255 : (blue < 0) ? 0 : blue;
-        }
-    }
+t_view bmp24_view(t_bmp24* img) {
+    t_view view = { img->data, img->width, img->height, img->stride, img->channels };
+    return view;
 }
+
 t_pixel bmp24_convolution(t_bmp24* img, int x, int y, float** kernel, int kernelSize) {
-    float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
+    double sumR = 0.0, sumG = 0.0, sumB = 0.0;
     int n = kernelSize / 2;
 
     for (int i = -n; i <= n; i++) {
+        int newY = y + i;
+        if (newY < 0 || newY >= img->height) continue;
         for (int j = -n; j <= n; j++) {
-            int newY = y + i;
             int newX = x + j;
-            
-            if (newY >= 0 && newY < img->height && newX >= 0 && newX < img->width) {
-                sumR += img->data[newY][newX].red * kernel[i + n][j + n];
-                sumG += img->data[newY][newX].green * kernel[i + n][j + n];
-                sumB += img->data[newY][newX].blue * kernel[i + n][j + n];
+
+            if (newX >= 0 && newX < img->width) {
+                const t_pixel* px = bmp24_pixel(img, newX, newY);
+                sumR += px->red * kernel[i + n][j + n];
+                sumG += px->green * kernel[i + n][j + n];
+                sumB += px->blue * kernel[i + n][j + n];
             }
         }
     }
@@ -238,101 +760,136 @@ t_pixel bmp24_convolution(t_bmp24* img, int x, int y, float** kernel, int kernel
 }
 
 void bmp24_applyFilter(t_bmp24* img, float** kernel, int kernelSize) {
+    bmp24_applyFilterEdge(img, kernel, kernelSize, EDGE_ZERO);
+}
+
+void bmp24_applyFilterEdge(t_bmp24* img, float** kernel, int kernelSize, t_edgeMode edge) {
     if (!img || !img->data || !kernel) return;
-    t_pixel** tempData = allocatePixelData(img->width, img->height);
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            tempData[y][x] = img->data[y][x];
-        }
+    if (kernelSize <= 0 || kernelSize % 2 == 0) {
+        printf("Error: Kernel size must be odd, got %d\n", kernelSize);
+        return;
     }
-    for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            img->data[y][x] = bmp24_convolution(img, x, y, kernel, kernelSize);
-        }
+
+    double start = trace_begin();
+    float* weights = (float*)bufferPool_get((size_t)kernelSize * kernelSize * sizeof(float), 0);
+    if (!weights) return;
+    for (int i = 0; i < kernelSize; i++) {
+        memcpy(weights + i * kernelSize, kernel[i], kernelSize * sizeof(float));
     }
 
-    freePixelData(tempData, img->height);
+    t_view view = bmp24_view(img);
+    conv_filter(&view, weights, kernelSize, edge);
+    bufferPool_release(weights);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_applyFilter", start);
 }
-void bmp24_boxBlur(t_bmp24* img) {
-    float** kernel = allocateKernel24(3);
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = 1.0f / 9.0f;
-        }
+
+void bmp24_applySeparableFilter(t_bmp24* img, const float* kernelX, const float* kernelY, int kernelSize) {
+    if (!img || !img->data || !kernelX || !kernelY) return;
+
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    conv_separable(&view, kernelX, kernelY, kernelSize, EDGE_ZERO);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_applySeparableFilter", start);
+}
+
+// The built-in kernels run through the fixed-point 3x3 path, which gives the
+// same bytes as the float path for these weights.
+static void applyFixedKernel(t_bmp24* img, const t_fixedKernel* kernel, const char* traceName) {
+    if (!img || !img->data) return;
+
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    conv3x3_apply(&view, kernel, EDGE_ZERO);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end(traceName, start);
+}
+
+// Median, min and max are percentiles 50, 0 and 100 of the same filter.
+static void applyRank(t_bmp24* img, int radius, float percentile, const char* traceName) {
+    if (!img || !img->data) return;
+    if (radius <= 0 || radius > RANK_MAX_RADIUS) {
+        printf("Error: Rank filter radius must be in [1, %d], got %d\n", RANK_MAX_RADIUS, radius);
+        return;
     }
-    
-    bmp24_applyFilter(img, kernel, 3);
-    freeKernel24(kernel, 3);
+
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    rank_filter(&view, radius, percentile);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end(traceName, start);
 }
 
-void bmp24_gaussianBlur(t_bmp24* img) {
-    float** kernel = allocateKernel24(3);
-    float gaussianKernel[3][3] = {
-        {1.0f/16, 2.0f/16, 1.0f/16},
-        {2.0f/16, 4.0f/16, 2.0f/16},
-        {1.0f/16, 2.0f/16, 1.0f/16}
-    };
-    
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = gaussianKernel[i][j];
-        }
+void bmp24_medianFilter(t_bmp24* img, int radius) {
+    applyRank(img, radius, 50.0f, "bmp24_medianFilter");
+}
+
+void bmp24_minFilter(t_bmp24* img, int radius) {
+    applyRank(img, radius, 0.0f, "bmp24_minFilter");
+}
+
+void bmp24_maxFilter(t_bmp24* img, int radius) {
+    applyRank(img, radius, 100.0f, "bmp24_maxFilter");
+}
+
+void bmp24_percentileFilter(t_bmp24* img, int radius, float percentile) {
+    applyRank(img, radius, percentile, "bmp24_percentileFilter");
+}
+
+int bmp24_applyNamedFilter(t_bmp24* img, const char* name) {
+    const t_kernel* kernel = kernelRegistry_find(name);
+    if (!kernel) {
+        printf("Error: Unknown kernel %s\n", name ? name : "(null)");
+        return -1;
     }
-    
-    bmp24_applyFilter(img, kernel, 3);
-    freeKernel24(kernel, 3);
+    if (!img || !img->data) return -1;
+
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    kernelRegistry_apply(&view, kernel, EDGE_ZERO);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_applyNamedFilter", start);
+    return 0;
+}
+
+void bmp24_boxBlur(t_bmp24* img) {
+    applyFixedKernel(img, &KERNEL3_BOX, "bmp24_boxBlur");
+}
+
+void bmp24_gaussianBlur(t_bmp24* img) {
+    applyFixedKernel(img, &KERNEL3_GAUSSIAN, "bmp24_gaussianBlur");
+}
+
+// Large-radius blurs cost the same per pixel whatever the radius.
+void bmp24_boxBlurRadius(t_bmp24* img, int radius) {
+    if (!img || !img->data) return;
+
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    conv_boxBlur(&view, radius);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_boxBlurRadius", start);
+}
+
+void bmp24_fastGaussianBlur(t_bmp24* img, float sigma) {
+    if (!img || !img->data) return;
+
+    double start = trace_begin();
+    t_view view = bmp24_view(img);
+    conv_fastGaussian(&view, sigma);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp24_fastGaussianBlur", start);
 }
 
 void bmp24_outline(t_bmp24* img) {
-    float** kernel = allocateKernel24(3);
-    float outlineKernel[3][3] = {
-        {-1, -1, -1},
-        {-1,  8, -1},
-        {-1, -1, -1}
-    };
-    
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = outlineKernel[i][j];
-        }
-    }
-    
-    bmp24_applyFilter(img, kernel, 3);
-    freeKernel24(kernel, 3);
+    applyFixedKernel(img, &KERNEL3_OUTLINE, "bmp24_outline");
 }
 
 void bmp24_emboss(t_bmp24* img) {
-    float** kernel = allocateKernel24(3);
-    float embossKernel[3][3] = {
-        {-2, -1,  0},
-        {-1,  1,  1},
-        { 0,  1,  2}
-    };
-    
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = embossKernel[i][j];
-        }
-    }
-    
-    bmp24_applyFilter(img, kernel, 3);
-    freeKernel24(kernel, 3);
+    applyFixedKernel(img, &KERNEL3_EMBOSS, "bmp24_emboss");
 }
 
 void bmp24_sharpen(t_bmp24* img) {
-    float** kernel = allocateKernel24(3);
-    float sharpenKernel[3][3] = {
-        { 0, -1,  0},
-        {-1,  5, -1},
-        { 0, -1,  0}
-    };
-    
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = sharpenKernel[i][j];
-        }
-    }
-    
-    bmp24_applyFilter(img, kernel, 3);
-    freeKernel24(kernel, 3);
-} 
\ No newline at end of file
+    applyFixedKernel(img, &KERNEL3_SHARPEN, "bmp24_sharpen");
+}
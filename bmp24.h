@@ -3,6 +3,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include "bmp8.h"
+#include "convolution.h"
+#include "image_view.h"
+#include "point_ops.h"
 
 
 typedef struct {
@@ -35,13 +40,27 @@ typedef struct {
 } t_pixel;
 
 
+// Pixels live in one aligned block laid out exactly like the file's pixel
+// array (bottom-up rows, each padded to 4 bytes). `data` points at the first
+// pixel of the top row and `stride` is the signed byte distance from row y to
+// row y + 1, so it is negative for the usual bottom-up files. Images loaded
+// with bmp24_loadImageMapped have no buffer: data points into the mapping.
+//
+// After bmp24_toBGRX the block instead holds PIXEL_BGRX32 pixels (channels
+// 4): top-down rows of 4 * width bytes with no padding, so no pixel
+// straddles a vector lane boundary. Saving converts back to the file layout.
 typedef struct {
     t_bmp_header header;
     t_bmp_info header_info;
     int width;
     int height;
     int colorDepth;
-    t_pixel **data;
+    int stride;
+    int channels;           // PIXEL_BGR24, or PIXEL_BGRX32 after bmp24_toBGRX
+    unsigned char *data;
+    unsigned char *buffer;
+    void *mapping;
+    size_t mappingSize;
 } t_bmp24;
 
 
@@ -56,26 +75,79 @@ typedef struct {
 #define HEADER_SIZE 0x0E
 #define INFO_SIZE 0x28
 #define DEFAULT_DEPTH 0x18
+#define PIXEL_ALIGNMENT 64
+
+
+static inline int bmp24_rowSize(int width) {
+    return ((width * 3 + 3) / 4) * 4;
+}
+
+static inline t_pixel* bmp24_row(const t_bmp24* img, int y) {
+    return (t_pixel*)(img->data + (ptrdiff_t)y * img->stride);
+}
+
+// t_pixel has no alignment, so this also addresses BGRX pixels; rows of
+// those cannot be indexed as t_pixel arrays.
+static inline t_pixel* bmp24_pixel(const t_bmp24* img, int x, int y) {
+    return (t_pixel*)((unsigned char*)bmp24_row(img, y) + (ptrdiff_t)x * img->channels);
+}
 
 
 t_bmp24* bmp24_loadImage(const char* filename);
-void bmp24_saveImage(const char* filename, t_bmp24* img);
+t_bmp24* bmp24_loadImageMapped(const char* filename);
+// For callers that already read the first HEADER_SIZE + INFO_SIZE bytes to
+// tell the depth apart: bmp24_readImage continues from the open file, and
+// bmp24_fromMapping takes over a whole-file mapping from file_map.
+t_bmp24* bmp24_readImage(FILE* file, const unsigned char* header);
+t_bmp24* bmp24_fromMapping(void* mapping, size_t size);
+int bmp24_saveImage(const char* filename, t_bmp24* img);
 void bmp24_free(t_bmp24* img);
 void bmp24_printInfo(t_bmp24* img);
 
+// Working format: bmp24_toBGRX moves the pixels into a new PIXEL_ALIGNMENT
+// block of BGRX32 pixels (the unused byte zero, dropped again on save) and
+// releases the old one or the mapping; bmp24_toBGR24 moves them back. Both
+// return 0 (also when already in that format), or -1 after printing why,
+// leaving the image as it was.
+int bmp24_toBGRX(t_bmp24* img);
+int bmp24_toBGR24(t_bmp24* img);
+
 void bmp24_readPixelValue(t_bmp24* img, int x, int y, FILE* file);
 void bmp24_writePixelValue(t_bmp24* img, int x, int y, FILE* file);
-void bmp24_readPixelData(t_bmp24* img, FILE* file);
-void bmp24_writePixelData(t_bmp24* img, FILE* file);
+int bmp24_readPixelData(t_bmp24* img, FILE* file);
+int bmp24_writePixelData(t_bmp24* img, FILE* file);
 
+void bmp24_applyPointOps(t_bmp24* img, const t_pointOps* ops);
 void bmp24_negative(t_bmp24* img);
 void bmp24_grayscale(t_bmp24* img);
+// A new 8-bit image of the luma (0.299 R + 0.587 G + 0.114 B, in fixed
+// point) with a grayscale color table, a third of the size; img is left as
+// it was. NULL (after printing why) when out of memory.
+t_bmp8* bmp24_toGray8(const t_bmp24* img);
 void bmp24_brightness(t_bmp24* img, int value);
 
+t_view bmp24_view(t_bmp24* img);
+
 t_pixel bmp24_convolution(t_bmp24* img, int x, int y, float** kernel, int kernelSize);
 void bmp24_applyFilter(t_bmp24* img, float** kernel, int kernelSize);
+// Same, with a choice of what samples past the image edges read;
+// bmp24_applyFilter uses EDGE_ZERO.
+void bmp24_applyFilterEdge(t_bmp24* img, float** kernel, int kernelSize, t_edgeMode edge);
+void bmp24_applySeparableFilter(t_bmp24* img, const float* kernelX, const float* kernelY, int kernelSize);
+// Noise removal: each channel sample becomes the median, minimum, maximum
+// or given percentile (0 to 100) of its (2 * radius + 1)^2 window, at the
+// same cost for any radius (see rank_filter.h).
+void bmp24_medianFilter(t_bmp24* img, int radius);
+void bmp24_minFilter(t_bmp24* img, int radius);
+void bmp24_maxFilter(t_bmp24* img, int radius);
+void bmp24_percentileFilter(t_bmp24* img, int radius, float percentile);
+// Applies a kernel from kernel_registry by name. Returns 0, or -1 (after
+// printing why) when no kernel has that name.
+int bmp24_applyNamedFilter(t_bmp24* img, const char* name);
 void bmp24_boxBlur(t_bmp24* img);
 void bmp24_gaussianBlur(t_bmp24* img);
+void bmp24_boxBlurRadius(t_bmp24* img, int radius);
+void bmp24_fastGaussianBlur(t_bmp24* img, float sigma);
 void bmp24_outline(t_bmp24* img);
 void bmp24_emboss(t_bmp24* img);
 void bmp24_sharpen(t_bmp24* img);
@@ -1,40 +1,56 @@
 #include "bmp8.h"
+#include "buffer_pool.h"
+#include "file_map.h"
+#include "convolution.h"
+#include "conv3x3.h"
+#include "kernel_registry.h"
+#include "pixel_format.h"
+#include "rank_filter.h"
+#include "trace.h"
+#include <limits.h>
 #include <string.h>
 #include <math.h>
 
-t_bmp8* bmp8_loadImage(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        printf("Error: Cannot open file %s\n", filename);
-        return NULL;
-    }
+// Rows are padded to 4 bytes in the file and kept that way in memory.
+static unsigned int rowStride(unsigned int width) {
+    return (width + 3) / 4 * 4;
+}
 
+// biSizeImage may legally be 0 for uncompressed files; derive it from the padded rows.
+static unsigned int imageDataSize(t_bmp8* img) {
+    if (img->dataSize != 0) return img->dataSize;
+    return rowStride(img->width) * img->height;
+}
+
+// Continues a file whose 54-byte header has been read into header: color
+// table, then pixel data. The caller keeps the file.
+t_bmp8* bmp8_readImage(FILE* file, const unsigned char header[54]) {
+    double start = trace_begin();
     t_bmp8* img = (t_bmp8*)malloc(sizeof(t_bmp8));
     if (!img) {
-        fclose(file);
         printf("Error: Memory allocation failed\n");
         return NULL;
     }
 
-
-    if (fread(img->header, sizeof(unsigned char), 54, file) != 54) {
-        printf("Error: Invalid BMP file format\n");
-        free(img);
-        fclose(file);
-        return NULL;
-    }
-
-
+    memcpy(img->header, header, 54);
     img->width = *(unsigned int*)&img->header[18];
     img->height = *(unsigned int*)&img->header[22];
     img->colorDepth = *(unsigned int*)&img->header[28];
     img->dataSize = *(unsigned int*)&img->header[34];
+    img->mapping = NULL;
+    img->mappingSize = 0;
 
     // Verify it's an 8-bit image
     if (img->colorDepth != 8) {
         printf("Error: Image must be 8-bit grayscale\n");
         free(img);
-        fclose(file);
+        return NULL;
+    }
+    img->dataSize = imageDataSize(img);
+    img->stride = rowStride(img->width);
+    if ((unsigned long long)img->stride * img->height > img->dataSize) {
+        printf("Error: Invalid BMP file format\n");
+        free(img);
         return NULL;
     }
 
@@ -42,57 +58,210 @@ t_bmp8* bmp8_loadImage(const char* filename) {
     if (fread(img->colorTable, sizeof(unsigned char), 1024, file) != 1024) {
         printf("Error: Could not read color table\n");
         free(img);
-        fclose(file);
         return NULL;
     }
 
 
-    img->data = (unsigned char*)malloc(img->dataSize);
+    img->data = (unsigned char*)bufferPool_get(img->dataSize, 0);
     if (!img->data) {
         printf("Error: Memory allocation failed for image data\n");
         free(img);
-        fclose(file);
         return NULL;
     }
 
 
     if (fread(img->data, sizeof(unsigned char), img->dataSize, file) != img->dataSize) {
         printf("Error: Could not read image data\n");
-        free(img->data);
+        bufferPool_release(img->data);
         free(img);
-        fclose(file);
         return NULL;
     }
 
-    fclose(file);
+    trace_add(TRACE_BYTES_READ, 54 + 1024 + (uint64_t)img->dataSize);
+    trace_end("bmp8_readImage", start);
     return img;
 }
 
-void bmp8_saveImage(const char* filename, t_bmp8* img) {
-    if (!img) return;
+// Takes ownership of a mapping from file_map, which is released on failure.
+// Pages come in as the pixels are touched; the whole mapping counts as read.
+t_bmp8* bmp8_fromMapping(void* mapping, size_t size) {
+    unsigned char* map = (unsigned char*)mapping;
+    t_bmp8* img = (t_bmp8*)malloc(sizeof(t_bmp8));
+    if (!img) {
+        file_unmap(map, size);
+        printf("Error: Memory allocation failed\n");
+        return NULL;
+    }
 
-    FILE* file = fopen(filename, "wb");
+    if (size < 54 + 1024) {
+        printf("Error: Invalid BMP file format\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+
+    memcpy(img->header, map, 54);
+    memcpy(img->colorTable, map + 54, 1024);
+    img->width = *(unsigned int*)&img->header[18];
+    img->height = *(unsigned int*)&img->header[22];
+    img->colorDepth = *(unsigned int*)&img->header[28];
+    img->dataSize = *(unsigned int*)&img->header[34];
+
+    if (img->colorDepth != 8) {
+        printf("Error: Image must be 8-bit grayscale\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+    img->dataSize = imageDataSize(img);
+    img->stride = rowStride(img->width);
+    if ((unsigned long long)img->stride * img->height > img->dataSize) {
+        printf("Error: Invalid BMP file format\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+
+    unsigned int offset = *(unsigned int*)&img->header[10];
+    if (offset > size || img->dataSize > size - offset) {
+        printf("Error: Could not read image data\n");
+        free(img);
+        file_unmap(map, size);
+        return NULL;
+    }
+
+    img->data = map + offset;
+    img->mapping = map;
+    img->mappingSize = size;
+    trace_add(TRACE_BYTES_READ, size);
+    return img;
+}
+
+t_bmp8* bmp8_loadImage(const char* filename) {
+    FILE* file = fopen(filename, "rb");
     if (!file) {
-        printf("Error: Cannot create file %s\n", filename);
-        return;
+        printf("Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+
+    double start = trace_begin();
+    unsigned char header[54];
+    t_bmp8* img = NULL;
+    if (fread(header, sizeof(unsigned char), 54, file) != 54) {
+        printf("Error: Invalid BMP file format\n");
+    } else {
+        img = bmp8_readImage(file, header);
+    }
+    fclose(file);
+    trace_end("bmp8_loadImage", start);
+    return img;
+}
+
+t_bmp8* bmp8_loadImageMapped(const char* filename) {
+    size_t size = 0;
+    void* map = file_map(filename, &size);
+    if (!map) {
+        printf("Error: Cannot map file %s\n", filename);
+        return NULL;
+    }
+
+    double start = trace_begin();
+    t_bmp8* img = bmp8_fromMapping(map, size);
+    trace_end("bmp8_loadImageMapped", start);
+    return img;
+}
+
+t_bmp8* bmp8_create(unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0 || width > INT_MAX - 3 || height > INT_MAX / ((width + 3) / 4 * 4)) {
+        printf("Error: Invalid image size %ux%u\n", width, height);
+        return NULL;
+    }
+    t_bmp8* img = (t_bmp8*)malloc(sizeof(t_bmp8));
+    if (!img) {
+        printf("Error: Memory allocation failed\n");
+        return NULL;
     }
 
+    img->width = width;
+    img->height = height;
+    img->colorDepth = 8;
+    img->stride = rowStride(width);
+    img->dataSize = img->stride * height;
+    img->mapping = NULL;
+    img->mappingSize = 0;
+    img->data = (unsigned char*)bufferPool_get(img->dataSize, 0);
+    if (!img->data) {
+        printf("Error: Memory allocation failed for image data\n");
+        free(img);
+        return NULL;
+    }
 
-    fwrite(img->header, sizeof(unsigned char), 54, file);
+    // BITMAPFILEHEADER and BITMAPINFOHEADER of an uncompressed bottom-up
+    // image, pixels right after the color table.
+    unsigned int offset = 54 + 1024, fileSize = offset + img->dataSize;
+    unsigned int infoSize = 40, compression = 0, colors = 256;
+    unsigned short planes = 1, bits = 8;
+    memset(img->header, 0, sizeof(img->header));
+    img->header[0] = 'B';
+    img->header[1] = 'M';
+    memcpy(&img->header[2], &fileSize, 4);
+    memcpy(&img->header[10], &offset, 4);
+    memcpy(&img->header[14], &infoSize, 4);
+    memcpy(&img->header[18], &width, 4);
+    memcpy(&img->header[22], &height, 4);
+    memcpy(&img->header[26], &planes, 2);
+    memcpy(&img->header[28], &bits, 2);
+    memcpy(&img->header[30], &compression, 4);
+    memcpy(&img->header[34], &img->dataSize, 4);
+    memcpy(&img->header[46], &colors, 4);
+
+    for (int i = 0; i < 256; i++) {
+        img->colorTable[4 * i] = img->colorTable[4 * i + 1] = img->colorTable[4 * i + 2] = (unsigned char)i;
+        img->colorTable[4 * i + 3] = 0;
+    }
+    return img;
+}
 
+// Row padding is not touched by the operations; keep the bytes written out zero.
+static void clearPadding(t_bmp8* img) {
+    int padding = (int)img->stride - (int)img->width;
+    if (padding <= 0 || !img->data) return;
+    for (unsigned int y = 0; y < img->height; y++) {
+        memset(img->data + (size_t)y * img->stride + img->width, 0, padding);
+    }
+}
 
-    fwrite(img->colorTable, sizeof(unsigned char), 1024, file);
+int bmp8_saveImage(const char* filename, t_bmp8* img) {
+    if (!img) return -1;
+    double start = trace_begin();
 
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Cannot create file %s\n", filename);
+        return -1;
+    }
 
-    fwrite(img->data, sizeof(unsigned char), img->dataSize, file);
+    clearPadding(img);
+    int status = 0;
+    if (fwrite(img->header, sizeof(unsigned char), 54, file) != 54 ||
+        fwrite(img->colorTable, sizeof(unsigned char), 1024, file) != 1024 ||
+        fwrite(img->data, sizeof(unsigned char), img->dataSize, file) != img->dataSize) {
+        printf("Error: Could not write file %s\n", filename);
+        status = -1;
+    }
 
-    fclose(file);
+    if (fclose(file) != 0) status = -1;
+    if (status == 0) trace_add(TRACE_BYTES_WRITTEN, 54 + 1024 + (uint64_t)img->dataSize);
+    trace_end("bmp8_saveImage", start);
+    return status;
 }
 
 void bmp8_free(t_bmp8* img) {
     if (img) {
-        if (img->data) {
-            free(img->data);
+        if (img->mapping) {
+            file_unmap(img->mapping, img->mappingSize);
+        } else if (img->data) {
+            bufferPool_release(img->data);
         }
         free(img);
     }
@@ -109,31 +278,37 @@ void bmp8_printInfo(t_bmp8* img) {
 }
 
 
-void bmp8_negative(t_bmp8* img) {
+// Point operations fold into one lookup table and make a single pass over the
+// pixels; the padding at the end of each row is left as it was.
+void bmp8_applyPointOps(t_bmp8* img, const t_pointOps* ops) {
     if (!img || !img->data) return;
 
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = 255 - img->data[i];
-    }
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    pointOps_apply(ops, &view);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_applyPointOps", start);
 }
 
-void bmp8_brightness(t_bmp8* img, int value) {
-    if (!img || !img->data) return;
+void bmp8_negative(t_bmp8* img) {
+    t_pointOps ops;
+    pointOps_init(&ops);
+    pointOps_negative(&ops);
+    bmp8_applyPointOps(img, &ops);
+}
 
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        int newValue = img->data[i] + value;
-        if (newValue > 255) newValue = 255;
-        if (newValue < 0) newValue = 0;
-        img->data[i] = (unsigned char)newValue;
-    }
+void bmp8_brightness(t_bmp8* img, int value) {
+    t_pointOps ops;
+    pointOps_init(&ops);
+    pointOps_brightness(&ops, value);
+    bmp8_applyPointOps(img, &ops);
 }
 
 void bmp8_threshold(t_bmp8* img, int threshold) {
-    if (!img || !img->data) return;
-
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = (img->data[i] >= threshold) ? 255 : 0;
-    }
+    t_pointOps ops;
+    pointOps_init(&ops);
+    pointOps_threshold(&ops, threshold);
+    bmp8_applyPointOps(img, &ops);
 }
 
 
@@ -153,119 +328,142 @@ void freeKernel(float** kernel, int size) {
     free(kernel);
 }
 
+t_view bmp8_view(t_bmp8* img) {
+    t_view view = { img->data, (int)img->width, (int)img->height, (int)img->stride, PIXEL_GRAY8 };
+    return view;
+}
+
 void bmp8_applyFilter(t_bmp8* img, float** kernel, int kernelSize) {
+    bmp8_applyFilterEdge(img, kernel, kernelSize, EDGE_UNTOUCHED);
+}
+
+void bmp8_applyFilterEdge(t_bmp8* img, float** kernel, int kernelSize, t_edgeMode edge) {
     if (!img || !img->data || !kernel) return;
+    if (kernelSize <= 0 || kernelSize % 2 == 0) {
+        printf("Error: Kernel size must be odd, got %d\n", kernelSize);
+        return;
+    }
 
-    unsigned char* tempData = (unsigned char*)malloc(img->dataSize);
-    if (!tempData) return;
-    memcpy(tempData, img->data, img->dataSize);
+    double start = trace_begin();
+    float* weights = (float*)bufferPool_get((size_t)kernelSize * kernelSize * sizeof(float), 0);
+    if (!weights) return;
+    for (int i = 0; i < kernelSize; i++) {
+        memcpy(weights + i * kernelSize, kernel[i], kernelSize * sizeof(float));
+    }
 
-    int n = kernelSize / 2;
+    t_view view = bmp8_view(img);
+    conv_filter(&view, weights, kernelSize, edge);
+    bufferPool_release(weights);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_applyFilter", start);
+}
 
+void bmp8_applySeparableFilter(t_bmp8* img, const float* kernelX, const float* kernelY, int kernelSize) {
+    if (!img || !img->data || !kernelX || !kernelY) return;
 
-    for (unsigned int y = n; y < img->height - n; y++) {
-        for (unsigned int x = n; x < img->width - n; x++) {
-            float sum = 0.0f;
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    conv_separable(&view, kernelX, kernelY, kernelSize, EDGE_UNTOUCHED);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_applySeparableFilter", start);
+}
 
+// The built-in kernels run through the fixed-point 3x3 path, which gives the
+// same bytes as the float path for these weights.
+static void applyFixedKernel(t_bmp8* img, const t_fixedKernel* kernel, const char* traceName) {
+    if (!img || !img->data) return;
 
-            for (int i = -n; i <= n; i++) {
-                for (int j = -n; j <= n; j++) {
-                    int pixelPos = (y + i) * img->width + (x + j);
-                    sum += tempData[pixelPos] * kernel[i + n][j + n];
-                }
-            }
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    conv3x3_apply(&view, kernel, EDGE_UNTOUCHED);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end(traceName, start);
+}
 
+// Median, min and max are percentiles 50, 0 and 100 of the same filter.
+static void applyRank(t_bmp8* img, int radius, float percentile, const char* traceName) {
+    if (!img || !img->data) return;
+    if (radius <= 0 || radius > RANK_MAX_RADIUS) {
+        printf("Error: Rank filter radius must be in [1, %d], got %d\n", RANK_MAX_RADIUS, radius);
+        return;
+    }
 
-            if (sum > 255) sum = 255;
-            if (sum < 0) sum = 0;
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    rank_filter(&view, radius, percentile);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end(traceName, start);
+}
 
-            img->data[y * img->width + x] = (unsigned char)sum;
-        }
-    }
+void bmp8_medianFilter(t_bmp8* img, int radius) {
+    applyRank(img, radius, 50.0f, "bmp8_medianFilter");
+}
 
-    free(tempData);
+void bmp8_minFilter(t_bmp8* img, int radius) {
+    applyRank(img, radius, 0.0f, "bmp8_minFilter");
 }
 
-void bmp8_boxBlur(t_bmp8* img) {
-    float** kernel = allocateKernel(3);
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = 1.0f / 9.0f;
-        }
+void bmp8_maxFilter(t_bmp8* img, int radius) {
+    applyRank(img, radius, 100.0f, "bmp8_maxFilter");
+}
+
+void bmp8_percentileFilter(t_bmp8* img, int radius, float percentile) {
+    applyRank(img, radius, percentile, "bmp8_percentileFilter");
+}
+
+int bmp8_applyNamedFilter(t_bmp8* img, const char* name) {
+    const t_kernel* kernel = kernelRegistry_find(name);
+    if (!kernel) {
+        printf("Error: Unknown kernel %s\n", name ? name : "(null)");
+        return -1;
     }
+    if (!img || !img->data) return -1;
+
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    kernelRegistry_apply(&view, kernel, EDGE_UNTOUCHED);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_applyNamedFilter", start);
+    return 0;
+}
 
-    bmp8_applyFilter(img, kernel, 3);
-    freeKernel(kernel, 3);
+void bmp8_boxBlur(t_bmp8* img) {
+    applyFixedKernel(img, &KERNEL3_BOX, "bmp8_boxBlur");
 }
 
 void bmp8_gaussianBlur(t_bmp8* img) {
-    float** kernel = allocateKernel(3);
-    float gaussianKernel[3][3] = {
-        {1.0f/16, 2.0f/16, 1.0f/16},
-        {2.0f/16, 4.0f/16, 2.0f/16},
-        {1.0f/16, 2.0f/16, 1.0f/16}
-    };
-
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = gaussianKernel[i][j];
-        }
-    }
+    applyFixedKernel(img, &KERNEL3_GAUSSIAN, "bmp8_gaussianBlur");
+}
+
+// Large-radius blurs cost the same per pixel whatever the radius.
+void bmp8_boxBlurRadius(t_bmp8* img, int radius) {
+    if (!img || !img->data) return;
 
-    bmp8_applyFilter(img, kernel, 3);
-    freeKernel(kernel, 3);
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    conv_boxBlur(&view, radius);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_boxBlurRadius", start);
 }
 
-void bmp8_outline(t_bmp8* img) {
-    float** kernel = allocateKernel(3);
-    float outlineKernel[3][3] = {
-        {-1, -1, -1},
-        {-1,  8, -1},
-        {-1, -1, -1}
-    };
-
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = outlineKernel[i][j];
-        }
-    }
+void bmp8_fastGaussianBlur(t_bmp8* img, float sigma) {
+    if (!img || !img->data) return;
 
-    bmp8_applyFilter(img, kernel, 3);
-    freeKernel(kernel, 3);
+    double start = trace_begin();
+    t_view view = bmp8_view(img);
+    conv_fastGaussian(&view, sigma);
+    trace_add(TRACE_PIXELS, (uint64_t)img->width * img->height);
+    trace_end("bmp8_fastGaussianBlur", start);
 }
 
-void bmp8_emboss(t_bmp8* img) {
-    float** kernel = allocateKernel(3);
-    float embossKernel[3][3] = {
-        {-2, -1,  0},
-        {-1,  1,  1},
-        { 0,  1,  2}
-    };
-
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = embossKernel[i][j];
-        }
-    }
+void bmp8_outline(t_bmp8* img) {
+    applyFixedKernel(img, &KERNEL3_OUTLINE, "bmp8_outline");
+}
 
-    bmp8_applyFilter(img, kernel, 3);
-    freeKernel(kernel, 3);
+void bmp8_emboss(t_bmp8* img) {
+    applyFixedKernel(img, &KERNEL3_EMBOSS, "bmp8_emboss");
 }
 
 void bmp8_sharpen(t_bmp8* img) {
-    float** kernel = allocateKernel(3);
-    float sharpenKernel[3][3] = {
-        { 0, -1,  0},
-        {-1,  5, -1},
-        { 0, -1,  0}
-    };
-
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            kernel[i][j] = sharpenKernel[i][j];
-        }
-    }
-
-    bmp8_applyFilter(img, kernel, 3);
-    freeKernel(kernel, 3);
-}
\ No newline at end of file
+    applyFixedKernel(img, &KERNEL3_SHARPEN, "bmp8_sharpen");
+}
@@ -3,6 +3,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "convolution.h"
+#include "image_view.h"
+#include "point_ops.h"
 
 typedef struct {
   unsigned char header[54];
@@ -12,20 +15,52 @@ typedef struct {
   unsigned int height;
   unsigned int colorDepth;
   unsigned int dataSize;
+  unsigned int stride;  // bytes from one row of data to the next
+  void* mapping;        // non-NULL when data points into a file mapping
+  size_t mappingSize;
 } t_bmp8;
 
 t_bmp8* bmp8_loadImage(const char* filename);
-void bmp8_saveImage(const char* filename, t_bmp8* img);
+t_bmp8* bmp8_loadImageMapped(const char* filename);
+// For callers that already read the header to tell the depth apart:
+// bmp8_readImage continues from just past the 54-byte header, and
+// bmp8_fromMapping takes over a whole-file mapping from file_map.
+t_bmp8* bmp8_readImage(FILE* file, const unsigned char header[54]);
+t_bmp8* bmp8_fromMapping(void* mapping, size_t size);
+// A width x height image laid out like a bottom-up file, with a header and a
+// grayscale color table filled in; the pixels are left to the caller. NULL
+// (after printing why) when the size is invalid or out of memory.
+t_bmp8* bmp8_create(unsigned int width, unsigned int height);
+int bmp8_saveImage(const char* filename, t_bmp8* img);
 void bmp8_free(t_bmp8* img);
 void bmp8_printInfo(t_bmp8* img);
 
+void bmp8_applyPointOps(t_bmp8* img, const t_pointOps* ops);
 void bmp8_negative(t_bmp8* img);
 void bmp8_brightness(t_bmp8* img, int value);
 void bmp8_threshold(t_bmp8* img, int threshold);
 
+t_view bmp8_view(t_bmp8* img);
+
 void bmp8_applyFilter(t_bmp8* img, float** kernel, int kernelSize);
+// Same, with a choice of what samples past the image edges read;
+// bmp8_applyFilter uses EDGE_UNTOUCHED.
+void bmp8_applyFilterEdge(t_bmp8* img, float** kernel, int kernelSize, t_edgeMode edge);
+void bmp8_applySeparableFilter(t_bmp8* img, const float* kernelX, const float* kernelY, int kernelSize);
+// Noise removal: each channel sample becomes the median, minimum, maximum
+// or given percentile (0 to 100) of its (2 * radius + 1)^2 window, at the
+// same cost for any radius (see rank_filter.h).
+void bmp8_medianFilter(t_bmp8* img, int radius);
+void bmp8_minFilter(t_bmp8* img, int radius);
+void bmp8_maxFilter(t_bmp8* img, int radius);
+void bmp8_percentileFilter(t_bmp8* img, int radius, float percentile);
+// Applies a kernel from kernel_registry by name. Returns 0, or -1 (after
+// printing why) when no kernel has that name.
+int bmp8_applyNamedFilter(t_bmp8* img, const char* name);
 void bmp8_boxBlur(t_bmp8* img);
 void bmp8_gaussianBlur(t_bmp8* img);
+void bmp8_boxBlurRadius(t_bmp8* img, int radius);
+void bmp8_fastGaussianBlur(t_bmp8* img, float sigma);
 void bmp8_outline(t_bmp8* img);
 void bmp8_emboss(t_bmp8* img);
 void bmp8_sharpen(t_bmp8* img);
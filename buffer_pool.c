@@ -0,0 +1,142 @@
+#include "buffer_pool.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sits just before every buffer handed out.
+typedef struct t_poolBlock {
+    struct t_poolBlock* next;   // idle list link
+    void* base;                 // what malloc returned
+    size_t size;                // size class
+    size_t alignment;
+} t_poolBlock;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static t_poolBlock* idleList = NULL;     // most recently released first
+static t_poolStats stats;
+
+// Rounds up to a multiple of an eighth of the size's highest power of two.
+// size <= SIZE_MAX / 2, so neither the steps nor the rounding overflow.
+static size_t sizeClass(size_t size, size_t alignment) {
+    size_t step = alignment;
+    while (step <= size / 16) step *= 2;
+    return (size + step - 1) / step * step;
+}
+
+static t_poolBlock* blockOf(void* buffer) {
+    return (t_poolBlock*)buffer - 1;
+}
+
+static void* bufferOf(t_poolBlock* block) {
+    return block + 1;
+}
+
+static void freeBlock(t_poolBlock* block) {
+    free(block->base);
+}
+
+void* bufferPool_get(size_t size, size_t alignment) {
+    if (alignment == 0) alignment = BUFFER_ALIGNMENT;
+    // The header must fit before the buffer and stay pointer-aligned.
+    if (alignment < sizeof(t_poolBlock)) alignment = sizeof(t_poolBlock);
+    // No allocation gets near these; a size computed from a bad header might.
+    if (size > SIZE_MAX / 2 || alignment > SIZE_MAX / 4) return NULL;
+    size_t size0 = sizeClass(size ? size : 1, alignment);
+    if (size0 > SIZE_MAX - alignment - sizeof(t_poolBlock)) return NULL;
+
+    pthread_mutex_lock(&lock);
+    t_poolBlock** link = &idleList;
+    while (*link && ((*link)->size != size0 || (*link)->alignment != alignment)) {
+        link = &(*link)->next;
+    }
+    t_poolBlock* block = *link;
+    if (block) {
+        *link = block->next;
+        stats.idle -= block->size;
+        stats.inUse += block->size;
+        stats.reused++;
+        pthread_mutex_unlock(&lock);
+        return bufferOf(block);
+    }
+    pthread_mutex_unlock(&lock);
+
+    void* base = malloc(size0 + alignment + sizeof(t_poolBlock));
+    if (!base) return NULL;
+    uintptr_t first = (uintptr_t)base + sizeof(t_poolBlock);
+    uintptr_t aligned = (first + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    block = (t_poolBlock*)aligned - 1;
+    block->next = NULL;
+    block->base = base;
+    block->size = size0;
+    block->alignment = alignment;
+    trace_add(TRACE_BYTES_ALLOCATED, size0);
+
+    pthread_mutex_lock(&lock);
+    stats.inUse += size0;
+    stats.allocated++;
+    if (stats.inUse + stats.idle > stats.highWater) stats.highWater = stats.inUse + stats.idle;
+    pthread_mutex_unlock(&lock);
+    return bufferOf(block);
+}
+
+void* bufferPool_getZeroed(size_t size, size_t alignment) {
+    void* buffer = bufferPool_get(size, alignment);
+    if (buffer) memset(buffer, 0, size);
+    return buffer;
+}
+
+void bufferPool_release(void* buffer) {
+    if (!buffer) return;
+    t_poolBlock* block = blockOf(buffer);
+    t_poolBlock* evicted = NULL;
+
+    pthread_mutex_lock(&lock);
+    stats.inUse -= block->size;
+    if (block->size > BUFFER_POOL_IDLE_LIMIT) {
+        block->next = evicted;
+        evicted = block;
+    } else {
+        block->next = idleList;
+        idleList = block;
+        stats.idle += block->size;
+        // Drop the least recently released buffers over the limit.
+        while (stats.idle > BUFFER_POOL_IDLE_LIMIT) {
+            t_poolBlock** link = &idleList;
+            while ((*link)->next) link = &(*link)->next;
+            t_poolBlock* oldest = *link;
+            *link = NULL;
+            stats.idle -= oldest->size;
+            oldest->next = evicted;
+            evicted = oldest;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    while (evicted) {
+        t_poolBlock* next = evicted->next;
+        freeBlock(evicted);
+        evicted = next;
+    }
+}
+
+void bufferPool_trim(void) {
+    pthread_mutex_lock(&lock);
+    t_poolBlock* list = idleList;
+    idleList = NULL;
+    stats.idle = 0;
+    pthread_mutex_unlock(&lock);
+
+    while (list) {
+        t_poolBlock* next = list->next;
+        freeBlock(list);
+        list = next;
+    }
+}
+
+void bufferPool_stats(t_poolStats* out) {
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,35 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+// Scratch and pixel buffers shared by every processing routine, so repeated
+// calls and images reuse memory instead of going back to the allocator.
+// Requests are rounded up to a size class (at most 1/8 larger) and matched on
+// class and alignment. Released buffers stay idle for reuse until the idle
+// total would pass BUFFER_POOL_IDLE_LIMIT. Safe to call from pool threads.
+#define BUFFER_POOL_IDLE_LIMIT ((size_t)256 << 20)
+
+// Default alignment: one cache line, and enough for any vector load.
+#define BUFFER_ALIGNMENT 64
+
+// Contents are undefined, except with bufferPool_getZeroed. Alignment is a
+// power of two; 0 selects BUFFER_ALIGNMENT. Returns NULL when out of memory.
+void* bufferPool_get(size_t size, size_t alignment);
+void* bufferPool_getZeroed(size_t size, size_t alignment);
+void bufferPool_release(void* buffer);
+
+// Frees every idle buffer.
+void bufferPool_trim(void);
+
+typedef struct {
+    size_t inUse;               // bytes handed out and not yet released
+    size_t idle;                // bytes kept for reuse
+    size_t highWater;           // most bytes held at once, in use plus idle
+    unsigned long reused;       // requests served by an idle buffer
+    unsigned long allocated;    // requests that went to the allocator
+} t_poolStats;
+
+void bufferPool_stats(t_poolStats* stats);
+
+#endif
@@ -0,0 +1,542 @@
+#include "conv3x3.h"
+#include "buffer_pool.h"
+#include "cpu_features.h"
+#include "pixel_format.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+#define DEFINE_KERNEL(NAME, label, t00, t01, t02, t10, t11, t12, t20, t21, t22, divisor) \
+    const t_fixedKernel KERNEL3_##NAME = { label, {{t00, t01, t02}, {t10, t11, t12}, {t20, t21, t22}}, divisor };
+CONV3X3_BUILTINS(DEFINE_KERNEL)
+
+// Non-zero taps of a kernel plus the way its divisor is applied: a shift for
+// powers of two, otherwise a 16-bit reciprocal with (sum * reciprocal) >> 16
+// equal to sum / divisor over the whole reachable sum range.
+typedef struct {
+    int count;
+    int row[9];       // 0: row above, 1: current row, 2: row below
+    int dx[9];
+    short weight[9];
+    int shift;
+    unsigned short reciprocal;
+} t_taps;
+
+typedef void (*t_rowKernel)(const unsigned char* const rows[3], unsigned char* out,
+                            int from, int to, int step, const t_taps* taps);
+
+static int prepareTaps(const t_fixedKernel* kernel, t_taps* taps) {
+    int positive = 0, negative = 0;
+    taps->count = 0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            short weight = kernel->taps[i][j];
+            if (weight == 0) continue;
+            if (weight > 0) positive += weight; else negative -= weight;
+            taps->row[taps->count] = i;
+            taps->dx[taps->count] = j - 1;
+            taps->weight[taps->count] = weight;
+            taps->count++;
+        }
+    }
+    // Every partial sum has to fit a signed 16-bit lane.
+    if (255 * positive > 32767 || 255 * negative > 32768 || kernel->divisor <= 0) return 0;
+
+    taps->shift = 0;
+    taps->reciprocal = 0;
+    while ((1 << taps->shift) < kernel->divisor) taps->shift++;
+    if ((1 << taps->shift) == kernel->divisor) return 1;
+
+    // The reciprocal path treats sums as unsigned.
+    unsigned int reciprocal = (65536 + kernel->divisor - 1) / kernel->divisor;
+    unsigned int error = reciprocal * kernel->divisor - 65536;
+    if (negative != 0 || (unsigned int)(255 * positive) * error >= 65536) return 0;
+    taps->reciprocal = (unsigned short)reciprocal;
+    return 1;
+}
+
+static unsigned char scaleSum(int sum, const t_taps* taps) {
+    if (taps->reciprocal) {
+        sum = (int)(((unsigned int)sum * taps->reciprocal) >> 16);
+    } else {
+        sum >>= taps->shift;
+    }
+    return (unsigned char)(sum > 255 ? 255 : sum < 0 ? 0 : sum);
+}
+
+// Tap-major over chunks of the row so the compiler can vectorize the inner loops.
+static void rowScalar(const unsigned char* const rows[3], unsigned char* out,
+                      int from, int to, int step, const t_taps* taps) {
+    int acc[256];
+    for (int chunk = from; chunk < to; chunk += 256) {
+        int length = to - chunk < 256 ? to - chunk : 256;
+        memset(acc, 0, length * sizeof(int));
+        for (int t = 0; t < taps->count; t++) {
+            const unsigned char* source = rows[taps->row[t]] + chunk + taps->dx[t] * step;
+            int weight = taps->weight[t];
+            for (int k = 0; k < length; k++) {
+                acc[k] += weight * source[k];
+            }
+        }
+        for (int k = 0; k < length; k++) {
+            out[chunk + k] = scaleSum(acc[k], taps);
+        }
+    }
+}
+
+#ifdef CPU_X86
+
+TARGET_SSE2 static void rowSSE2(const unsigned char* const rows[3], unsigned char* out,
+                                int from, int to, int step, const t_taps* taps) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i reciprocal = _mm_set1_epi16((short)taps->reciprocal);
+    const __m128i shift = _mm_cvtsi32_si128(taps->shift);
+    __m128i weights[9];
+    for (int t = 0; t < taps->count; t++) {
+        weights[t] = _mm_set1_epi16(taps->weight[t]);
+    }
+
+    int k = from;
+    for (; k + 16 <= to; k += 16) {
+        __m128i lo = zero, hi = zero;
+        for (int t = 0; t < taps->count; t++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(rows[taps->row[t]] + k + taps->dx[t] * step));
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), weights[t]));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), weights[t]));
+        }
+        if (taps->reciprocal) {
+            lo = _mm_mulhi_epu16(lo, reciprocal);
+            hi = _mm_mulhi_epu16(hi, reciprocal);
+        } else {
+            lo = _mm_sra_epi16(lo, shift);
+            hi = _mm_sra_epi16(hi, shift);
+        }
+        // Saturating pack: the same clamp to [0, 255] as the scalar code.
+        _mm_storeu_si128((__m128i*)(out + k), _mm_packus_epi16(lo, hi));
+    }
+    rowScalar(rows, out, k, to, step, taps);
+}
+
+TARGET_AVX2 static void rowAVX2(const unsigned char* const rows[3], unsigned char* out,
+                                int from, int to, int step, const t_taps* taps) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i reciprocal = _mm256_set1_epi16((short)taps->reciprocal);
+    const __m128i shift = _mm_cvtsi32_si128(taps->shift);
+    __m256i weights[9];
+    for (int t = 0; t < taps->count; t++) {
+        weights[t] = _mm256_set1_epi16(taps->weight[t]);
+    }
+
+    int k = from;
+    for (; k + 32 <= to; k += 32) {
+        __m256i lo = zero, hi = zero;
+        for (int t = 0; t < taps->count; t++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(rows[taps->row[t]] + k + taps->dx[t] * step));
+            lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), weights[t]));
+            hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), weights[t]));
+        }
+        if (taps->reciprocal) {
+            lo = _mm256_mulhi_epu16(lo, reciprocal);
+            hi = _mm256_mulhi_epu16(hi, reciprocal);
+        } else {
+            lo = _mm256_sra_epi16(lo, shift);
+            hi = _mm256_sra_epi16(hi, shift);
+        }
+        // Unpack and pack both work per 128-bit lane, so the bytes come back in order.
+        _mm256_storeu_si256((__m256i*)(out + k), _mm256_packus_epi16(lo, hi));
+    }
+    rowSSE2(rows, out, k, to, step, taps);
+}
+
+#endif
+
+// Specialized rows. The *Fixed bodies take the taps as arguments and are
+// only ever inlined into the per-kernel wrappers below, where the taps are
+// literals: the compiler unrolls the taps and folds every test on them.
+
+// top * above + middle * center + bottom * below.
+static ALWAYS_INLINE int columnScalar(int top, int middle, int bottom, int above, int center, int below) {
+    int sum = middle * center;
+    if (top == bottom) return sum + top * (above + below);
+    return sum + top * above + bottom * below;
+}
+
+static ALWAYS_INLINE void rowScalarFixed(const unsigned char* const rows[3], unsigned char* out,
+                                         int from, int to, int step, const t_taps* taps,
+                                         int t00, int t01, int t02, int t10, int t11, int t12,
+                                         int t20, int t21, int t22) {
+    const unsigned char* above = rows[0];
+    const unsigned char* center = rows[1];
+    const unsigned char* below = rows[2];
+    for (int k = from; k < to; k++) {
+        int sum = columnScalar(t00, t10, t20, above[k - step], center[k - step], below[k - step])
+                + columnScalar(t01, t11, t21, above[k], center[k], below[k])
+                + columnScalar(t02, t12, t22, above[k + step], center[k + step], below[k + step]);
+        out[k] = scaleSum(sum, taps);
+    }
+}
+
+#ifdef CPU_X86
+
+// Sums wrap in 16 bits exactly as in the generic path, so regrouping the
+// terms gives the same lanes.
+TARGET_SSE2 static ALWAYS_INLINE __m128i scaleSSE2(__m128i v, int weight) {
+    if (weight == 1) return v;
+    if (weight == -1) return _mm_sub_epi16(_mm_setzero_si128(), v);
+    if (weight == 2) return _mm_add_epi16(v, v);
+    if (weight == 4) return _mm_slli_epi16(v, 2);
+    if (weight == 8) return _mm_slli_epi16(v, 3);
+    return _mm_mullo_epi16(v, _mm_set1_epi16((short)weight));
+}
+
+// Adds the taps of one column, at offset at, to the low and high halves.
+TARGET_SSE2 static ALWAYS_INLINE void columnSSE2(const unsigned char* const rows[3], int at,
+                                                  int top, int middle, int bottom, __m128i* lo, __m128i* hi) {
+    const __m128i zero = _mm_setzero_si128();
+    if (middle != 0) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(rows[1] + at));
+        *lo = _mm_add_epi16(*lo, scaleSSE2(_mm_unpacklo_epi8(v, zero), middle));
+        *hi = _mm_add_epi16(*hi, scaleSSE2(_mm_unpackhi_epi8(v, zero), middle));
+    }
+    if (top != 0 && top == bottom) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(rows[0] + at));
+        __m128i b = _mm_loadu_si128((const __m128i*)(rows[2] + at));
+        __m128i pairLo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i pairHi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        *lo = _mm_add_epi16(*lo, scaleSSE2(pairLo, top));
+        *hi = _mm_add_epi16(*hi, scaleSSE2(pairHi, top));
+        return;
+    }
+    if (top != 0) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(rows[0] + at));
+        *lo = _mm_add_epi16(*lo, scaleSSE2(_mm_unpacklo_epi8(v, zero), top));
+        *hi = _mm_add_epi16(*hi, scaleSSE2(_mm_unpackhi_epi8(v, zero), top));
+    }
+    if (bottom != 0) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(rows[2] + at));
+        *lo = _mm_add_epi16(*lo, scaleSSE2(_mm_unpacklo_epi8(v, zero), bottom));
+        *hi = _mm_add_epi16(*hi, scaleSSE2(_mm_unpackhi_epi8(v, zero), bottom));
+    }
+}
+
+TARGET_SSE2 static ALWAYS_INLINE void rowSSE2Fixed(const unsigned char* const rows[3], unsigned char* out,
+                                                    int from, int to, int step, const t_taps* taps,
+                                                    int t00, int t01, int t02, int t10, int t11, int t12,
+                                                    int t20, int t21, int t22) {
+    const __m128i reciprocal = _mm_set1_epi16((short)taps->reciprocal);
+    const __m128i shift = _mm_cvtsi32_si128(taps->shift);
+
+    int k = from;
+    for (; k + 16 <= to; k += 16) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        columnSSE2(rows, k - step, t00, t10, t20, &lo, &hi);
+        columnSSE2(rows, k, t01, t11, t21, &lo, &hi);
+        columnSSE2(rows, k + step, t02, t12, t22, &lo, &hi);
+        if (taps->reciprocal) {
+            lo = _mm_mulhi_epu16(lo, reciprocal);
+            hi = _mm_mulhi_epu16(hi, reciprocal);
+        } else {
+            lo = _mm_sra_epi16(lo, shift);
+            hi = _mm_sra_epi16(hi, shift);
+        }
+        _mm_storeu_si128((__m128i*)(out + k), _mm_packus_epi16(lo, hi));
+    }
+    rowScalarFixed(rows, out, k, to, step, taps, t00, t01, t02, t10, t11, t12, t20, t21, t22);
+}
+
+TARGET_AVX2 static ALWAYS_INLINE __m256i scaleAVX2(__m256i v, int weight) {
+    if (weight == 1) return v;
+    if (weight == -1) return _mm256_sub_epi16(_mm256_setzero_si256(), v);
+    if (weight == 2) return _mm256_add_epi16(v, v);
+    if (weight == 4) return _mm256_slli_epi16(v, 2);
+    if (weight == 8) return _mm256_slli_epi16(v, 3);
+    return _mm256_mullo_epi16(v, _mm256_set1_epi16((short)weight));
+}
+
+TARGET_AVX2 static ALWAYS_INLINE void columnAVX2(const unsigned char* const rows[3], int at,
+                                                  int top, int middle, int bottom, __m256i* lo, __m256i* hi) {
+    const __m256i zero = _mm256_setzero_si256();
+    if (middle != 0) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(rows[1] + at));
+        *lo = _mm256_add_epi16(*lo, scaleAVX2(_mm256_unpacklo_epi8(v, zero), middle));
+        *hi = _mm256_add_epi16(*hi, scaleAVX2(_mm256_unpackhi_epi8(v, zero), middle));
+    }
+    if (top != 0 && top == bottom) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(rows[0] + at));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(rows[2] + at));
+        __m256i pairLo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        __m256i pairHi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        *lo = _mm256_add_epi16(*lo, scaleAVX2(pairLo, top));
+        *hi = _mm256_add_epi16(*hi, scaleAVX2(pairHi, top));
+        return;
+    }
+    if (top != 0) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(rows[0] + at));
+        *lo = _mm256_add_epi16(*lo, scaleAVX2(_mm256_unpacklo_epi8(v, zero), top));
+        *hi = _mm256_add_epi16(*hi, scaleAVX2(_mm256_unpackhi_epi8(v, zero), top));
+    }
+    if (bottom != 0) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(rows[2] + at));
+        *lo = _mm256_add_epi16(*lo, scaleAVX2(_mm256_unpacklo_epi8(v, zero), bottom));
+        *hi = _mm256_add_epi16(*hi, scaleAVX2(_mm256_unpackhi_epi8(v, zero), bottom));
+    }
+}
+
+TARGET_AVX2 static ALWAYS_INLINE void rowAVX2Fixed(const unsigned char* const rows[3], unsigned char* out,
+                                                    int from, int to, int step, const t_taps* taps,
+                                                    int t00, int t01, int t02, int t10, int t11, int t12,
+                                                    int t20, int t21, int t22) {
+    const __m256i reciprocal = _mm256_set1_epi16((short)taps->reciprocal);
+    const __m128i shift = _mm_cvtsi32_si128(taps->shift);
+
+    int k = from;
+    for (; k + 32 <= to; k += 32) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        columnAVX2(rows, k - step, t00, t10, t20, &lo, &hi);
+        columnAVX2(rows, k, t01, t11, t21, &lo, &hi);
+        columnAVX2(rows, k + step, t02, t12, t22, &lo, &hi);
+        if (taps->reciprocal) {
+            lo = _mm256_mulhi_epu16(lo, reciprocal);
+            hi = _mm256_mulhi_epu16(hi, reciprocal);
+        } else {
+            lo = _mm256_sra_epi16(lo, shift);
+            hi = _mm256_sra_epi16(hi, shift);
+        }
+        _mm256_storeu_si256((__m256i*)(out + k), _mm256_packus_epi16(lo, hi));
+    }
+    rowSSE2Fixed(rows, out, k, to, step, taps, t00, t01, t02, t10, t11, t12, t20, t21, t22);
+}
+
+#define SPECIALIZE(NAME, label, ...) \
+    static void rowScalar##NAME(const unsigned char* const rows[3], unsigned char* out, \
+                                int from, int to, int step, const t_taps* taps) { \
+        rowScalarFixed(rows, out, from, to, step, taps, __VA_ARGS__); \
+    } \
+    TARGET_SSE2 static void rowSSE2##NAME(const unsigned char* const rows[3], unsigned char* out, \
+                                          int from, int to, int step, const t_taps* taps) { \
+        rowSSE2Fixed(rows, out, from, to, step, taps, __VA_ARGS__); \
+    } \
+    TARGET_AVX2 static void rowAVX2##NAME(const unsigned char* const rows[3], unsigned char* out, \
+                                          int from, int to, int step, const t_taps* taps) { \
+        rowAVX2Fixed(rows, out, from, to, step, taps, __VA_ARGS__); \
+    }
+#define SPECIALIZED_ENTRY(NAME, ...) { &KERNEL3_##NAME, { rowScalar##NAME, rowSSE2##NAME, rowAVX2##NAME } },
+
+#else
+
+#define SPECIALIZE(NAME, label, ...) \
+    static void rowScalar##NAME(const unsigned char* const rows[3], unsigned char* out, \
+                                int from, int to, int step, const t_taps* taps) { \
+        rowScalarFixed(rows, out, from, to, step, taps, __VA_ARGS__); \
+    }
+#define SPECIALIZED_ENTRY(NAME, ...) { &KERNEL3_##NAME, { rowScalar##NAME, rowScalar##NAME, rowScalar##NAME } },
+
+#endif
+
+// The divisor is left out: scaleSum and the vector paths take it from t_taps.
+#define SPECIALIZE_TAPS(NAME, label, t00, t01, t02, t10, t11, t12, t20, t21, t22, divisor) \
+    SPECIALIZE(NAME, label, t00, t01, t02, t10, t11, t12, t20, t21, t22)
+CONV3X3_BUILTINS(SPECIALIZE_TAPS)
+
+typedef struct {
+    const t_fixedKernel* kernel;
+    t_rowKernel rows[3];      // scalar, SSE2, AVX2
+} t_specialized;
+
+static const t_specialized SPECIALIZED[] = {
+    CONV3X3_BUILTINS(SPECIALIZED_ENTRY)
+};
+
+static t_rowKernel rowKernelFor(const t_fixedKernel* kernel, t_simdLevel level, int specialize) {
+    int path = 0;
+#ifdef CPU_X86
+    if (level >= SIMD_AVX2) path = 2;
+    else if (level >= SIMD_SSE2) path = 1;
+#else
+    (void)level;
+#endif
+    if (specialize) {
+        for (size_t k = 0; k < sizeof(SPECIALIZED) / sizeof(SPECIALIZED[0]); k++) {
+            if (SPECIALIZED[k].kernel == kernel) return SPECIALIZED[k].rows[path];
+        }
+    }
+#ifdef CPU_X86
+    if (path == 2) return rowAVX2;
+    if (path == 1) return rowSSE2;
+#endif
+    return rowScalar;
+}
+
+// Pixel x with samples outside the row read as zero.
+static void borderPixel(const unsigned char* const rows[3], unsigned char* out,
+                        int x, int width, int channels, const t_taps* taps) {
+    for (int ch = 0; ch < channels; ch++) {
+        int sum = 0;
+        for (int t = 0; t < taps->count; t++) {
+            int sx = x + taps->dx[t];
+            if (sx < 0 || sx >= width) continue;
+            sum += taps->weight[t] * rows[taps->row[t]][sx * channels + ch];
+        }
+        out[x * channels + ch] = scaleSum(sum, taps);
+    }
+}
+
+typedef struct {
+    t_taps taps;
+    t_rowKernel rowKernel;
+    t_edgeMode edge;
+} t_conv3x3Job;
+
+static void applyBand(void* context, t_view* view, const t_band* band) {
+    t_conv3x3Job* job = (t_conv3x3Job*)context;
+    int width = view->width;
+    int c = view->channels;
+    int rowLen = width * c;
+    int y0 = band->y0, y1 = band->y1;
+    if (job->edge == EDGE_UNTOUCHED) {
+        if (y0 < 1) y0 = 1;
+        if (y1 > view->height - 1) y1 = view->height - 1;
+        if (width < 3) return;
+    }
+    if (y0 >= y1) return;
+
+    // Original copies of rows y - 1 and y; row y + 1 is still untouched in the image.
+    unsigned char* buffer = (unsigned char*)bufferPool_getZeroed(3 * (size_t)rowLen, 0);
+    if (!buffer) return;
+    unsigned char* previous = buffer;
+    unsigned char* current = buffer + rowLen;
+    const unsigned char* zeroRow = buffer + 2 * rowLen;
+
+    for (int y = y0; y < y1; y++) {
+        unsigned char* out = view_row(view, y);
+        memcpy(current, out, rowLen);
+        const unsigned char* rows[3] = {
+            y == 0 ? zeroRow : y == y0 ? band_row(view, band, y - 1) : previous,
+            current,
+            y + 1 < view->height ? band_row(view, band, y + 1) : zeroRow
+        };
+
+        if (width > 2) job->rowKernel(rows, out, c, (width - 1) * c, c, &job->taps);
+        if (job->edge == EDGE_ZERO) {
+            borderPixel(rows, out, 0, width, c, &job->taps);
+            if (width > 1) borderPixel(rows, out, width - 1, width, c, &job->taps);
+        }
+
+        unsigned char* swap = previous;
+        previous = current;
+        current = swap;
+    }
+    bufferPool_release(buffer);
+}
+
+static void applyWithLevel(t_view* view, const t_fixedKernel* kernel, t_edgeMode edge, t_simdLevel level,
+                           int specialize) {
+    if (!view || !view->data || !kernel || view->width <= 0) return;
+
+    float weights[9];
+    for (int k = 0; k < 9; k++) {
+        weights[k] = (float)kernel->taps[k / 3][k % 3] / kernel->divisor;
+    }
+    t_conv3x3Job job;
+    if (!prepareTaps(kernel, &job.taps)) {
+        // Fixed point cannot represent this kernel exactly; use the float path.
+        conv_filter(view, weights, 3, edge);
+        return;
+    }
+
+    unsigned char* frame = NULL;
+    if (edge != EDGE_UNTOUCHED && edge != EDGE_ZERO) {
+        frame = conv_borderFilter(view, weights, 3, edge);
+        if (!frame) return;
+        edge = EDGE_UNTOUCHED;
+    }
+    job.rowKernel = rowKernelFor(kernel, level, specialize);
+    job.edge = edge;
+    conv_forBands(view, 1, applyBand, &job);
+    conv_borderStore(view, 3, frame);
+}
+
+void conv3x3_apply(t_view* view, const t_fixedKernel* kernel, t_edgeMode edge) {
+    applyWithLevel(view, kernel, edge, cpu_simdLevel(), 1);
+}
+
+// path 0: float, 1: generic fixed point, 2: specialized fixed point.
+static double timeRun(const t_view* source, t_view* work, const t_fixedKernel* kernel, int path, t_simdLevel level) {
+    size_t bytes = (size_t)source->width * source->channels * source->height;
+    double best = 0.0;
+    for (int run = 0; run < 3; run++) {
+        memcpy(work->data, source->data, bytes);
+        double start = timing_now();
+        if (path == 0) {
+            float weights[9];
+            for (int k = 0; k < 9; k++) {
+                weights[k] = (float)kernel->taps[k / 3][k % 3] / kernel->divisor;
+            }
+            conv_filter(work, weights, 3, EDGE_ZERO);
+        } else {
+            applyWithLevel(work, kernel, EDGE_ZERO, level, path == 2);
+        }
+        double elapsed = timing_now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+void conv3x3_reportSpeedups(FILE* out, int width, int height) {
+    const t_fixedKernel* kernels[] = {
+#define KERNEL_ADDRESS(NAME, ...) &KERNEL3_##NAME,
+        CONV3X3_BUILTINS(KERNEL_ADDRESS)
+#undef KERNEL_ADDRESS
+    };
+    int kernelCount = (int)(sizeof(kernels) / sizeof(kernels[0]));
+    t_simdLevel level = cpu_simdLevel();
+    static const t_pixelFormat formats[] = { PIXEL_GRAY8, PIXEL_BGR24, PIXEL_BGRX32 };
+
+    for (int f = 0; f < 3; f++) {
+        int channels = formats[f];
+        size_t bytes = (size_t)width * channels * height;
+        unsigned char* source = (unsigned char*)malloc(bytes);
+        unsigned char* work = (unsigned char*)malloc(bytes);
+        unsigned char* expected = (unsigned char*)malloc(bytes);
+        if (!source || !work || !expected) {
+            free(source);
+            free(work);
+            free(expected);
+            return;
+        }
+        unsigned int seed = 12345;
+        for (size_t k = 0; k < bytes; k++) {
+            seed = seed * 1103515245u + 12345u;
+            source[k] = (unsigned char)(seed >> 16);
+        }
+
+        t_view sourceView = { source, width, height, width * channels, channels };
+        t_view workView = sourceView;
+        workView.data = work;
+
+        fprintf(out, "3x3 kernels, %dx%d, %d-bit, vector path %s:\n", width, height, channels * 8, cpu_simdName(level));
+        fprintf(out, "  %-9s %10s %10s %10s %10s %9s %9s  %s\n", "kernel",
+                "float ms", "scalar ms", "vector ms", "special ms", "vs float", "vs vector", "output");
+        for (int k = 0; k < kernelCount; k++) {
+            double floatTime = timeRun(&sourceView, &workView, kernels[k], 0, level);
+            memcpy(expected, work, bytes);
+            double scalarTime = timeRun(&sourceView, &workView, kernels[k], 1, SIMD_SCALAR);
+            int identical = memcmp(expected, work, bytes) == 0;
+            double vectorTime = timeRun(&sourceView, &workView, kernels[k], 1, level);
+            identical = identical && memcmp(expected, work, bytes) == 0;
+            double specialTime = timeRun(&sourceView, &workView, kernels[k], 2, level);
+            identical = identical && memcmp(expected, work, bytes) == 0;
+            fprintf(out, "  %-9s %10.2f %10.2f %10.2f %10.2f %8.1fx %8.1fx  %s\n", kernels[k]->name,
+                    floatTime * 1e3, scalarTime * 1e3, vectorTime * 1e3, specialTime * 1e3,
+                    floatTime / specialTime, vectorTime / specialTime, identical ? "identical" : "MISMATCH");
+        }
+
+        free(source);
+        free(work);
+        free(expected);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef CONV3X3_H
+#define CONV3X3_H
+
+#include <stdio.h>
+#include "convolution.h"
+
+// 3x3 kernel with small integer taps, applied in 16-bit fixed point: the tap
+// sum is divided by divisor with truncation, then clamped to [0, 255]. For
+// the built-in kernels this gives exactly the bytes of the float path.
+typedef struct {
+    const char* name;
+    short taps[3][3];
+    int divisor;
+} t_fixedKernel;
+
+// The built-in kernels: constant name, registry name, taps row by row and
+// divisor. One line here declares KERNEL3_<NAME>, generates its unrolled row
+// functions in conv3x3.c and registers it by name in kernel_registry.c.
+#define CONV3X3_BUILTINS(X) \
+    X(BOX,      "box",      1,  1,  1,    1, 1,  1,    1, 1, 1,  9) \
+    X(GAUSSIAN, "gaussian", 1,  2,  1,    2, 4,  2,    1, 2, 1,  16) \
+    X(OUTLINE,  "outline",  -1, -1, -1,   -1, 8, -1,   -1, -1, -1, 1) \
+    X(EMBOSS,   "emboss",   -2, -1, 0,    -1, 1, 1,    0, 1, 2,  1) \
+    X(SHARPEN,  "sharpen",  0,  -1, 0,    -1, 5, -1,   0, -1, 0, 1)
+
+#define CONV3X3_DECLARE(NAME, ...) extern const t_fixedKernel KERNEL3_##NAME;
+CONV3X3_BUILTINS(CONV3X3_DECLARE)
+#undef CONV3X3_DECLARE
+
+// Vectorized with AVX2 (32 samples per instruction) or SSE2 (16), whichever
+// cpu_simdLevel() allows, with a scalar fallback. Built-in kernels run row
+// functions specialized for their taps: unrolled, zero taps dropped, +-1 and
+// powers of two as adds and shifts, and equal weights above and below the
+// centre sharing one multiply. Any other kernel runs the generic tap loop.
+// The other edge modes run the one-pixel frame through conv_borderFilter.
+void conv3x3_apply(t_view* view, const t_fixedKernel* kernel, t_edgeMode edge);
+
+// Times every built-in kernel on a synthetic width x height image with the
+// generic float path, the scalar and vector generic fixed-point paths and
+// the specialized vector path, and prints the speedups.
+void conv3x3_reportSpeedups(FILE* out, int width, int height);
+
+#endif
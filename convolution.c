@@ -0,0 +1,695 @@
+#include "convolution.h"
+#include "buffer_pool.h"
+#include "cpu_features.h"
+#include "fft.h"
+#include "pixel_format.h"
+#include "thread_pool.h"
+#include <limits.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+static unsigned char toByte(double sum) {
+    if (sum > 255) sum = 255;
+    if (sum < 0) sum = 0;
+    return (unsigned char)sum;
+}
+
+static int maxInt(int a, int b) { return a > b ? a : b; }
+static int minInt(int a, int b) { return a < b ? a : b; }
+
+// Pixel range [*x0, *x1) and row range [*y0, *y1) that the edge mode lets us write.
+static int outputRange(const t_view* view, int n, t_edgeMode edge, int* x0, int* x1, int* y0, int* y1) {
+    *x0 = 0;
+    *x1 = view->width;
+    if (edge == EDGE_UNTOUCHED) {
+        *x0 = n;
+        *x1 = view->width - n;
+        *y0 = maxInt(*y0, n);
+        *y1 = minInt(*y1, view->height - n);
+    }
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+// acc[k] += weight * row[k + dx * channels] for every output pixel whose
+// shifted sample lies inside the row; the clipping replaces per-tap checks.
+static void accumulateShifted(double* acc, const unsigned char* row, double weight, int dx,
+                              int width, int channels, int x0, int x1) {
+    int from = maxInt(x0, -dx);
+    int to = minInt(x1, width - dx);
+    const unsigned char* shifted = row + dx * channels;
+    for (int k = from * channels; k < to * channels; k++) {
+        acc[k] += weight * shifted[k];
+    }
+}
+
+static void directRows(const t_view* src, t_view* dst, const float* kernel, int size,
+                       t_edgeMode edge, int y0, int y1, double* acc) {
+    int n = size / 2;
+    int c = src->channels;
+    int x0, x1;
+    if (!outputRange(src, n, edge, &x0, &x1, &y0, &y1)) return;
+
+    for (int y = y0; y < y1; y++) {
+        memset(acc, 0, (size_t)src->width * c * sizeof(double));
+        for (int i = -n; i <= n; i++) {
+            int sy = y + i;
+            if (sy < 0 || sy >= src->height) continue;
+            const unsigned char* row = view_row(src, sy);
+            for (int j = -n; j <= n; j++) {
+                float weight = kernel[(i + n) * size + (j + n)];
+                if (weight == 0.0f) continue;
+                accumulateShifted(acc, row, weight, j, src->width, c, x0, x1);
+            }
+        }
+
+        unsigned char* out = view_row(dst, y);
+        for (int k = x0 * c; k < x1 * c; k++) {
+            out[k] = toByte(acc[k]);
+        }
+    }
+}
+
+typedef struct {
+    t_view* view;
+    t_view source;
+    const float* kernel;
+    const float* kernelX;
+    const float* kernelY;
+    int size;
+    t_edgeMode edge;
+} t_convJob;
+
+static void copyBand(void* context, int y0, int y1) {
+    t_convJob* job = (t_convJob*)context;
+    size_t rowBytes = (size_t)job->view->width * job->view->channels;
+    for (int y = y0; y < y1; y++) {
+        memcpy(view_row(&job->source, y), view_row(job->view, y), rowBytes);
+    }
+}
+
+static void directBand(void* context, int y0, int y1) {
+    t_convJob* job = (t_convJob*)context;
+    double* acc = (double*)bufferPool_get((size_t)job->view->width * job->view->channels * sizeof(double), 0);
+    if (!acc) return;
+    directRows(&job->source, job->view, job->kernel, job->size, job->edge, y0, y1, acc);
+    bufferPool_release(acc);
+}
+
+void conv_direct(t_view* view, const float* kernel, int size, t_edgeMode edge) {
+    if (!view || !view->data || !kernel) return;
+
+    size_t rowBytes = (size_t)view->width * view->channels;
+    unsigned char* tempData = (unsigned char*)bufferPool_get(rowBytes * view->height, 0);
+    if (!tempData) return;
+
+    t_convJob job = { view, { tempData, view->width, view->height, (int)rowBytes, view->channels },
+                      kernel, NULL, NULL, size, edge };
+    threadPool_forBands(view->height, 16, copyBand, &job);
+    threadPool_forBands(view->height, 1, directBand, &job);
+
+    bufferPool_release(tempData);
+}
+
+// Rows of one band, in place. The ring holds the horizontal pass of the last
+// size source rows; row y + n is passed before row y is written, and rows
+// outside the band come from its halo copies.
+static void separableRows(t_view* view, const t_band* band, const float* kernelX, const float* kernelY,
+                          int size, t_edgeMode edge, double* ring, double* acc) {
+    int n = size / 2;
+    int c = view->channels;
+    int rowLen = view->width * c;
+    int x0, x1;
+    int y0 = band->y0, y1 = band->y1;
+    if (!outputRange(view, n, edge, &x0, &x1, &y0, &y1)) return;
+
+    int next = maxInt(y0 - n, 0);
+    for (int y = y0; y < y1; y++) {
+        int last = minInt(y + n, view->height - 1);
+        for (; next <= last; next++) {
+            double* passed = ring + (size_t)(next % size) * rowLen;
+            memset(passed, 0, (size_t)rowLen * sizeof(double));
+            const unsigned char* row = band_row(view, band, next);
+            for (int j = -n; j <= n; j++) {
+                if (kernelX[j + n] == 0.0f) continue;
+                accumulateShifted(passed, row, kernelX[j + n], j, view->width, c, x0, x1);
+            }
+        }
+
+        memset(acc, 0, (size_t)rowLen * sizeof(double));
+        for (int i = -n; i <= n; i++) {
+            int sy = y + i;
+            double weight = kernelY[i + n];
+            if (sy < 0 || sy >= view->height || weight == 0.0) continue;
+            const double* passed = ring + (size_t)(sy % size) * rowLen;
+            for (int k = x0 * c; k < x1 * c; k++) {
+                acc[k] += weight * passed[k];
+            }
+        }
+
+        unsigned char* out = view_row(view, y);
+        for (int k = x0 * c; k < x1 * c; k++) {
+            out[k] = toByte(acc[k]);
+        }
+    }
+}
+
+static void separableBand(void* context, t_view* view, const t_band* band) {
+    t_convJob* job = (t_convJob*)context;
+    size_t rowLen = (size_t)view->width * view->channels;
+    double* ring = (double*)bufferPool_get((size_t)(job->size + 1) * rowLen * sizeof(double), 0);
+    if (!ring) return;
+    separableRows(view, band, job->kernelX, job->kernelY, job->size, job->edge, ring, ring + (size_t)job->size * rowLen);
+    bufferPool_release(ring);
+}
+
+void conv_separable(t_view* view, const float* kernelX, const float* kernelY, int size, t_edgeMode edge) {
+    if (!view || !view->data || !kernelX || !kernelY) return;
+
+    t_convJob job = { view, *view, NULL, kernelX, kernelY, size, edge };
+    conv_forBands(view, size / 2, separableBand, &job);
+}
+
+static int clampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// Moves the window sums of pixel x to x + 1, reading the pixels entering
+// and leaving it.
+static ALWAYS_INLINE void slideSums(uint32_t* sum, uint32_t* out, const unsigned char* entering,
+                                    const unsigned char* leaving, int channels) {
+    PIXEL_UNROLL for (int ch = 0; ch < channels; ch++) {
+        out[ch] = sum[ch];
+        sum[ch] += entering[ch] - leaving[ch];
+    }
+}
+
+// Sliding sums of 2 * radius + 1 samples along one row, edge pixels repeated.
+static ALWAYS_INLINE void horizontalSumsOf(const unsigned char* row, int width, int channels, int radius,
+                                           uint32_t* sums) {
+    uint32_t sum[PIXEL_MAX_CHANNELS] = { 0 };
+    for (int j = -radius; j <= radius; j++) {
+        const unsigned char* px = row + clampInt(j, 0, width - 1) * channels;
+        PIXEL_UNROLL for (int ch = 0; ch < channels; ch++) {
+            sum[ch] += px[ch];
+        }
+    }
+    // Only the steps within radius + 1 of either edge need clamped indices.
+    int head = radius < width ? radius : width;
+    int tail = width - radius - 1 > head ? width - radius - 1 : head;
+    int x = 0;
+    for (; x < head; x++) {
+        slideSums(sum, sums + x * channels, row + clampInt(x + radius + 1, 0, width - 1) * channels,
+                  row + clampInt(x - radius, 0, width - 1) * channels, channels);
+    }
+    for (; x < tail; x++) {
+        slideSums(sum, sums + x * channels, row + (x + radius + 1) * channels, row + (x - radius) * channels,
+                  channels);
+    }
+    for (; x < width; x++) {
+        slideSums(sum, sums + x * channels, row + clampInt(x + radius + 1, 0, width - 1) * channels,
+                  row + clampInt(x - radius, 0, width - 1) * channels, channels);
+    }
+}
+
+#ifdef CPU_X86
+
+TARGET_SSE2 static ALWAYS_INLINE __m128i widenPixel(const unsigned char* px) {
+    const __m128i zero = _mm_setzero_si128();
+    int bytes;
+    memcpy(&bytes, px, sizeof(bytes));
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+}
+
+TARGET_SSE2 static ALWAYS_INLINE __m128i slidePixel(__m128i sum, uint32_t* out, const unsigned char* entering,
+                                                    const unsigned char* leaving) {
+    _mm_storeu_si128((__m128i*)out, sum);
+    return _mm_add_epi32(sum, _mm_sub_epi32(widenPixel(entering), widenPixel(leaving)));
+}
+
+// horizontalSumsOf for BGRX: a pixel's four sums are one vector, so each
+// step is one add and one subtract instead of four of each.
+TARGET_SSE2 static void horizontalSumsBGRX(const unsigned char* row, int width, int radius, uint32_t* sums) {
+    __m128i sum = _mm_setzero_si128();
+    for (int j = -radius; j <= radius; j++) {
+        sum = _mm_add_epi32(sum, widenPixel(row + clampInt(j, 0, width - 1) * 4));
+    }
+    int head = radius < width ? radius : width;
+    int tail = width - radius - 1 > head ? width - radius - 1 : head;
+    int x = 0;
+    for (; x < head; x++) {
+        sum = slidePixel(sum, sums + 4 * x, row + clampInt(x + radius + 1, 0, width - 1) * 4,
+                         row + clampInt(x - radius, 0, width - 1) * 4);
+    }
+    for (; x < tail; x++) {
+        sum = slidePixel(sum, sums + 4 * x, row + (x + radius + 1) * 4, row + (x - radius) * 4);
+    }
+    for (; x < width; x++) {
+        sum = slidePixel(sum, sums + 4 * x, row + clampInt(x + radius + 1, 0, width - 1) * 4,
+                         row + clampInt(x - radius, 0, width - 1) * 4);
+    }
+}
+
+#endif
+
+static void horizontalSums(const unsigned char* row, int width, int channels, int radius, uint32_t* sums) {
+#ifdef CPU_X86
+    if (channels == PIXEL_BGRX32 && cpu_simdLevel() >= SIMD_SSE2) {
+        horizontalSumsBGRX(row, width, radius, sums);
+        return;
+    }
+#endif
+    PIXEL_DISPATCH(channels, horizontalSumsOf(row, width, PIXEL_CHANNELS, radius, sums));
+}
+
+// Largest ring of horizontal sums a band keeps; past it, the band keeps the
+// window's source rows instead (a quarter of the size) and sums the row
+// leaving the window again.
+#define BOX_RING_BYTES ((size_t)32 << 20)
+
+static void boxBand(void* context, t_view* view, const t_band* band) {
+    int radius = *(const int*)context;
+    int size = 2 * radius + 1;
+    int rowLen = view->width * view->channels;
+    int last = view->height - 1;
+    uint32_t area = (uint32_t)size * size;
+
+    // floor(value / area) as one multiply, exact while value * area < 2^40.
+    uint64_t reciprocal = ((uint64_t)1 << 40) / area + 1;
+    int useReciprocal = (uint64_t)256 * area * area < ((uint64_t)1 << 40);
+
+    // Slot p % size of the ring holds the horizontal sums of window row p.
+    // Past BOX_RING_BYTES the ring has one slot, for the sums of the leaving
+    // row, and slot p % size of rows holds a copy of window row p: the band
+    // is filtered in place, so the leaving row cannot be read back.
+    int slots = (size_t)size * rowLen * sizeof(uint32_t) <= BOX_RING_BYTES ? size : 1;
+    uint32_t* ring = (uint32_t*)bufferPool_get((size_t)(slots + 2) * rowLen * sizeof(uint32_t), 0);
+    unsigned char* rows = slots == 1 ? (unsigned char*)bufferPool_get((size_t)size * rowLen, 0) : NULL;
+    if (!ring || (slots == 1 && !rows)) {
+        bufferPool_release(ring);
+        return;
+    }
+    uint32_t* columns = ring + (size_t)slots * rowLen;
+    uint32_t* entering = columns + rowLen;
+
+    int y0 = band->y0;
+    memset(columns, 0, (size_t)rowLen * sizeof(uint32_t));
+    for (int p = y0 - radius; p <= y0 + radius; p++) {
+        uint32_t* slot = ring + (size_t)((p % slots + slots) % slots) * rowLen;
+        const unsigned char* source = band_row(view, band, clampInt(p, 0, last));
+        if (rows) memcpy(rows + (size_t)((p % size + size) % size) * rowLen, source, rowLen);
+        horizontalSums(source, view->width, view->channels, radius, slot);
+        for (int k = 0; k < rowLen; k++) {
+            columns[k] += slot[k];
+        }
+    }
+
+    for (int y = y0; y < band->y1; y++) {
+        unsigned char* out = view_row(view, y);
+        if (useReciprocal) {
+            for (int k = 0; k < rowLen; k++) {
+                out[k] = (unsigned char)(((columns[k] + area / 2) * reciprocal) >> 40);
+            }
+        } else {
+            for (int k = 0; k < rowLen; k++) {
+                out[k] = (unsigned char)((columns[k] + area / 2) / area);
+            }
+        }
+
+        if (y + 1 < band->y1) {
+            // Row y - radius leaves the window and row y + radius + 1 enters
+            // the same ring slot.
+            int p = y + radius + 1;
+            uint32_t* slot = ring + (size_t)((p % slots + slots) % slots) * rowLen;
+            const unsigned char* source = band_row(view, band, clampInt(p, 0, last));
+            if (rows) {
+                // Row y - radius leaves from the slot row p is copied to.
+                unsigned char* kept = rows + (size_t)((p % size + size) % size) * rowLen;
+                horizontalSums(kept, view->width, view->channels, radius, slot);
+                memcpy(kept, source, rowLen);
+            }
+            horizontalSums(source, view->width, view->channels, radius, entering);
+            for (int k = 0; k < rowLen; k++) {
+                columns[k] += entering[k] - slot[k];
+                slot[k] = entering[k];
+            }
+        }
+    }
+    bufferPool_release(rows);
+    bufferPool_release(ring);
+}
+
+void conv_boxBlur(t_view* view, int radius) {
+    if (!view || !view->data || radius <= 0 || view->width <= 0) return;
+    if (radius > CONV_MAX_BOX_RADIUS) {
+        printf("Error: Box blur radius must be in [1, %d], got %d\n", CONV_MAX_BOX_RADIUS, radius);
+        return;
+    }
+
+    conv_forBands(view, radius, boxBand, &radius);
+}
+
+// Box radii whose three-pass variance best matches sigma^2: widths wl and
+// wl + 2, with wl the largest odd width not above the ideal one.
+static void gaussianBoxes(float sigma, int radii[3]) {
+    const int passes = 3;
+    double variance = 12.0 * sigma * sigma;
+    int lower = (int)floor(sqrt(variance / passes + 1.0));
+    if (lower % 2 == 0) lower--;
+    int upper = lower + 2;
+    int lowerPasses = (int)floor((variance - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes)
+                                 / (-4.0 * lower - 4.0) + 0.5);
+
+    for (int pass = 0; pass < passes; pass++) {
+        int width = pass < lowerPasses ? lower : upper;
+        radii[pass] = (width - 1) / 2;
+    }
+}
+
+void conv_fastGaussian(t_view* view, float sigma) {
+    if (!view || sigma <= 0.0f) return;
+
+    int radii[3];
+    gaussianBoxes(sigma, radii);
+    for (int pass = 0; pass < 3; pass++) {
+        conv_boxBlur(view, radii[pass]);
+    }
+}
+
+int conv_fastGaussianRadius(float sigma) {
+    if (sigma <= 0.0f) return 0;
+
+    int radii[3];
+    gaussianBoxes(sigma, radii);
+    return radii[0] + radii[1] + radii[2];
+}
+
+typedef struct {
+    t_view* view;
+    int bands;
+    t_band* split;
+    t_viewBandFn fn;
+    void* context;
+} t_bandJob;
+
+static void runViewBand(void* context, int index) {
+    t_bandJob* job = (t_bandJob*)context;
+    job->fn(job->context, job->view, &job->split[index]);
+}
+
+void conv_forBands(t_view* view, int radius, t_viewBandFn fn, void* context) {
+    int rowLen = view->width * view->channels;
+    int bands = threadPool_bandCount(view->height, maxInt(2 * radius, 16));
+    if (bands <= 1) {
+        t_band whole = { 0, view->height, radius, rowLen, NULL, NULL };
+        fn(context, view, &whole);
+        return;
+    }
+
+    // Snapshot every band's halo before any band starts writing.
+    size_t haloBytes = (size_t)radius * rowLen;
+    t_band* split = (t_band*)bufferPool_get(bands * sizeof(t_band), 0);
+    unsigned char* halos = (unsigned char*)bufferPool_get(2 * haloBytes * bands + 1, 0);
+    if (!split || !halos) {
+        bufferPool_release(split);
+        bufferPool_release(halos);
+        return;
+    }
+    for (int b = 0; b < bands; b++) {
+        t_band* band = &split[b];
+        band->y0 = (int)((long long)view->height * b / bands);
+        band->y1 = (int)((long long)view->height * (b + 1) / bands);
+        band->radius = radius;
+        band->rowLen = rowLen;
+        unsigned char* above = halos + 2 * haloBytes * b;
+        unsigned char* below = above + haloBytes;
+        for (int k = 0; k < radius; k++) {
+            int y = band->y0 - radius + k;
+            if (y >= 0) memcpy(above + (size_t)k * rowLen, view_row(view, y), rowLen);
+            y = band->y1 + k;
+            if (y < view->height) memcpy(below + (size_t)k * rowLen, view_row(view, y), rowLen);
+        }
+        band->above = above;
+        band->below = below;
+    }
+
+    t_bandJob job = { view, bands, split, fn, context };
+    threadPool_parallelFor(bands, runViewBand, &job);
+
+    bufferPool_release(halos);
+    bufferPool_release(split);
+}
+
+// Exponent of the lowest set bit of a non-zero float.
+static int lowestBit(float value) {
+    int exponent;
+    double mantissa = frexp(fabs(value), &exponent);
+    long bits = (long)ldexp(mantissa, 24);
+    int low = exponent - 24;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        low++;
+    }
+    return low;
+}
+
+// Every partial sum of weights[] times samples in [0, 255] is a multiple of
+// 2^*low no larger than 255 * *magnitude.
+static void sumPrecision(const float* weights, int size, double* magnitude, int* low) {
+    *magnitude = 0.0;
+    *low = INT_MAX;
+    for (int k = 0; k < size; k++) {
+        if (weights[k] == 0.0f) continue;
+        *magnitude += fabs(weights[k]);
+        *low = minInt(*low, lowestBit(weights[k]));
+    }
+}
+
+// Candidate factors kernelX = pivot row / scale, kernelY = pivot column *
+// scale / pivot. Fails unless both are floats whose products give back every
+// weight exactly.
+static int factorize(const float* kernel, int size, int pivot, double scale, float* kernelX, float* kernelY) {
+    int pivotRow = pivot / size;
+    int pivotColumn = pivot % size;
+    for (int k = 0; k < size; k++) {
+        double x = kernel[pivotRow * size + k] / scale;
+        double y = kernel[k * size + pivotColumn] * scale / kernel[pivot];
+        if ((double)(float)x != x || (double)(float)y != y) return 0;
+        kernelX[k] = (float)x;
+        kernelY[k] = (float)y;
+    }
+    // Products of two floats are exact in a double, so this is an exact test.
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if ((double)kernelY[i] * kernelX[j] != (double)kernel[i * size + j]) return 0;
+        }
+    }
+    return 1;
+}
+
+// Smallest non-zero magnitude among count weights step apart.
+static double smallestWeight(const float* weights, int count, int step) {
+    double smallest = 0.0;
+    for (int k = 0; k < count; k++) {
+        double w = fabs(weights[k * step]);
+        if (w != 0.0 && (smallest == 0.0 || w < smallest)) smallest = w;
+    }
+    return smallest;
+}
+
+int conv_separate(const float* kernel, int size, float* kernelX, float* kernelY) {
+    if (!kernel || size <= 0) return 0;
+
+    int pivot = 0;
+    for (int k = 1; k < size * size; k++) {
+        if (fabs(kernel[k]) > fabs(kernel[pivot])) pivot = k;
+    }
+    if (kernel[pivot] == 0.0f) return 0;
+
+    // Try to leave one factor integral (e.g. {1, 2, 1} x {1/16, 2/16, 1/16})
+    // before falling back to putting the whole pivot on either side.
+    double scales[4] = {
+        smallestWeight(kernel + (pivot / size) * size, size, 1),
+        kernel[pivot] / smallestWeight(kernel + pivot % size, size, size),
+        1.0,
+        kernel[pivot]
+    };
+    int found = 0;
+    for (int k = 0; k < 4 && !found; k++) {
+        found = factorize(kernel, size, pivot, scales[k], kernelX, kernelY);
+    }
+    if (!found) return 0;
+
+    double magnitudeX, magnitudeY;
+    int lowX, lowY, highX, high;
+    sumPrecision(kernelX, size, &magnitudeX, &lowX);
+    sumPrecision(kernelY, size, &magnitudeY, &lowY);
+    frexp(magnitudeX * 255.0, &highX);
+    frexp(magnitudeX * magnitudeY * 255.0, &high);
+    return highX - lowX <= 53 && high - (lowX + lowY) <= 53;
+}
+
+// Where sample i of a row or column of length n comes from, or -1 for zero.
+static int edgeIndex(int i, int n, t_edgeMode edge) {
+    if (i >= 0 && i < n) return i;
+    switch (edge) {
+        case EDGE_CLAMP:
+            return i < 0 ? 0 : n - 1;
+        case EDGE_MIRROR: {
+            if (n == 1) return 0;
+            int period = 2 * (n - 1);
+            i %= period;
+            if (i < 0) i += period;
+            return i < n ? i : period - i;
+        }
+        case EDGE_WRAP:
+            i %= n;
+            return i < 0 ? i + n : i;
+        default:
+            return -1;
+    }
+}
+
+// Frame bytes stored for rows before y: whole rows within n of the top or
+// bottom, and the n pixels at either end of every row in between.
+static size_t frameOffset(const t_view* view, int n, int y) {
+    int top = minInt(n, view->height);
+    int bottom = maxInt(view->height - n, top);
+    size_t rowLen = (size_t)view->width * view->channels;
+    size_t sideLen = (size_t)minInt(2 * n, view->width) * view->channels;
+    if (y <= top) return y * rowLen;
+    if (y <= bottom) return top * rowLen + (y - top) * sideLen;
+    return top * rowLen + (bottom - top) * sideLen + (y - bottom) * rowLen;
+}
+
+// Pixel spans of row y that belong to the frame; returns how many.
+static int frameSpans(const t_view* view, int n, int y, int spans[2][2]) {
+    if (y < n || y >= view->height - n || view->width <= 2 * n) {
+        spans[0][0] = 0;
+        spans[0][1] = view->width;
+        return 1;
+    }
+    spans[0][0] = 0;
+    spans[0][1] = n;
+    spans[1][0] = view->width - n;
+    spans[1][1] = view->width;
+    return 2;
+}
+
+typedef struct {
+    const t_view* view;
+    const float* kernel;
+    int size;
+    t_edgeMode edge;
+    unsigned char* frame;
+} t_borderJob;
+
+static void borderBand(void* context, int y0, int y1) {
+    t_borderJob* job = (t_borderJob*)context;
+    const t_view* view = job->view;
+    int n = job->size / 2;
+    int c = view->channels;
+
+    for (int y = y0; y < y1; y++) {
+        unsigned char* out = job->frame + frameOffset(view, n, y);
+        int spans[2][2];
+        int count = frameSpans(view, n, y, spans);
+        for (int s = 0; s < count; s++) {
+            for (int x = spans[s][0]; x < spans[s][1]; x++) {
+                for (int ch = 0; ch < c; ch++) {
+                    double sum = 0.0;
+                    for (int i = -n; i <= n; i++) {
+                        int sy = edgeIndex(y + i, view->height, job->edge);
+                        if (sy < 0) continue;
+                        const unsigned char* row = view_row(view, sy);
+                        for (int j = -n; j <= n; j++) {
+                            double weight = job->kernel[(i + n) * job->size + (j + n)];
+                            int sx = edgeIndex(x + j, view->width, job->edge);
+                            if (weight == 0.0 || sx < 0) continue;
+                            sum += weight * row[sx * c + ch];
+                        }
+                    }
+                    *out++ = toByte(sum);
+                }
+            }
+        }
+    }
+}
+
+unsigned char* conv_borderFilter(const t_view* view, const float* kernel, int size, t_edgeMode edge) {
+    int n = size / 2;
+    unsigned char* frame = (unsigned char*)bufferPool_get(frameOffset(view, n, view->height) + 1, 0);
+    if (!frame) return NULL;
+
+    t_borderJob job = { view, kernel, size, edge, frame };
+    threadPool_forBands(view->height, maxInt(n, 16), borderBand, &job);
+    return frame;
+}
+
+void conv_borderStore(t_view* view, int size, unsigned char* frame) {
+    if (!frame) return;
+
+    int n = size / 2;
+    int c = view->channels;
+    const unsigned char* in = frame;
+    for (int y = 0; y < view->height; y++) {
+        unsigned char* row = view_row(view, y);
+        int spans[2][2];
+        int count = frameSpans(view, n, y, spans);
+        for (int s = 0; s < count; s++) {
+            size_t bytes = (size_t)(spans[s][1] - spans[s][0]) * c;
+            memcpy(row + spans[s][0] * c, in, bytes);
+            in += bytes;
+        }
+    }
+    bufferPool_release(frame);
+}
+
+t_convMethod conv_chooseMethod(int width, int height, int size, int taps, int separable) {
+    t_convMethod method = CONV_DIRECT;
+    double cost = taps;
+    if (separable && 2.0 * size < cost) {
+        method = CONV_SEPARABLE;
+        cost = 2.0 * size;
+    }
+    if (fft_cost(width, height, size) < cost) method = CONV_FFT;
+    return method;
+}
+
+void conv_filter(t_view* view, const float* kernel, int size, t_edgeMode edge) {
+    if (!view || !view->data || !kernel || size <= 0 || size % 2 == 0) return;
+
+    unsigned char* frame = NULL;
+    if (edge != EDGE_UNTOUCHED && edge != EDGE_ZERO) {
+        frame = conv_borderFilter(view, kernel, size, edge);
+        if (!frame) return;
+        edge = EDGE_UNTOUCHED;
+    }
+
+    int taps = 0;
+    for (int i = 0; i < size * size; i++) {
+        taps += kernel[i] != 0.0f;
+    }
+    float* factors = (float*)bufferPool_get(2 * (size_t)size * sizeof(float), 0);
+    int separable = factors && conv_separate(kernel, size, factors, factors + size);
+
+    switch (conv_chooseMethod(view->width, view->height, size, taps, separable)) {
+        case CONV_SEPARABLE:
+            conv_separable(view, factors, factors + size, size, edge);
+            break;
+        case CONV_FFT:
+            fft_convolve(view, kernel, size, edge);
+            break;
+        default:
+            conv_direct(view, kernel, size, edge);
+            break;
+    }
+    bufferPool_release(factors);
+    conv_borderStore(view, size, frame);
+}
@@ -0,0 +1,91 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include "image_view.h"
+
+// What happens to pixels whose kernel window leaves the image.
+typedef enum {
+    EDGE_UNTOUCHED,   // border pixels keep their value (bmp8 behaviour)
+    EDGE_ZERO,        // samples outside the image count as 0 (bmp24 behaviour)
+    EDGE_CLAMP,       // samples outside repeat the nearest edge pixel
+    EDGE_MIRROR,      // samples outside reflect about the edge pixel: 2 1 | 0 1 2
+    EDGE_WRAP         // samples outside come from the opposite edge
+} t_edgeMode;
+
+// Kernels are row-major size x size arrays with an odd size. All paths sum in
+// double precision, then clamp to [0, 255] and truncate like the original code.
+
+typedef enum {
+    CONV_DIRECT,      // one multiply-add per non-zero weight
+    CONV_SEPARABLE,   // 2 * size per sample, exact rank-1 kernels only
+    CONV_FFT          // fft_convolve: O(log tile), within FFT_BIAS of direct
+} t_convMethod;
+
+// Cheapest path by estimated cost per sample; ties go to the exact paths.
+t_convMethod conv_chooseMethod(int width, int height, int size, int taps, int separable);
+
+// Filters with the path conv_chooseMethod picks for the kernel. Direct and
+// separable give identical bytes; see fft.h for the FFT path's tolerance.
+// Takes every edge mode; the paths below and fft_convolve take
+// EDGE_UNTOUCHED and EDGE_ZERO only.
+void conv_filter(t_view* view, const float* kernel, int size, t_edgeMode edge);
+void conv_direct(t_view* view, const float* kernel, int size, t_edgeMode edge);
+
+// Horizontal pass with kernelX, then vertical pass with kernelY: O(size) per
+// pixel, working in place with a ring of size intermediate rows.
+void conv_separable(t_view* view, const float* kernelX, const float* kernelY, int size, t_edgeMode edge);
+
+// The other edge modes split the work: the interior runs through a fast path
+// with EDGE_UNTOUCHED, so no tap checks where it lies, and the frame of size / 2
+// pixels it leaves is filtered here with remapped samples. conv_borderFilter
+// must read the unfiltered image, so it fills a buffer that conv_borderStore
+// writes back (and releases) once the interior is done. The frame sums taps in
+// the order conv_direct does, so it matches direct filtering of a padded image.
+unsigned char* conv_borderFilter(const t_view* view, const float* kernel, int size, t_edgeMode edge);
+void conv_borderStore(t_view* view, int size, unsigned char* frame);
+
+// A band of rows [y0, y1) that is filtered in place, with copies of the
+// radius rows on either side taken before any band wrote to the image.
+typedef struct {
+    int y0;
+    int y1;
+    int radius;
+    int rowLen;
+    const unsigned char* above;   // rows y0 - radius .. y0 - 1
+    const unsigned char* below;   // rows y1 .. y1 + radius - 1
+} t_band;
+
+typedef void (*t_viewBandFn)(void* context, t_view* view, const t_band* band);
+
+// Runs fn on horizontal bands of view on the thread pool. Rows outside the
+// band must be read with band_row, which returns their original values.
+void conv_forBands(t_view* view, int radius, t_viewBandFn fn, void* context);
+
+static inline const unsigned char* band_row(const t_view* view, const t_band* band, int y) {
+    if (y < band->y0) return band->above + (size_t)(y - band->y0 + band->radius) * band->rowLen;
+    if (y >= band->y1) return band->below + (size_t)(y - band->y1) * band->rowLen;
+    return view_row(view, y);
+}
+
+// Mean over a (2 * radius + 1)^2 window, rounded to nearest, in O(1) per
+// pixel from running integer sums. Samples past the border repeat the edge
+// pixel, so large radii do not darken or skip the image edges. The window
+// sums are 32-bit, which bounds the radius (larger ones print an error and
+// leave the image as it was).
+#define CONV_MAX_BOX_RADIUS 2047
+
+void conv_boxBlur(t_view* view, int radius);
+
+// Approximates a gaussian of the given sigma with three box blurs whose
+// sizes are chosen to match its variance.
+void conv_fastGaussian(t_view* view, float sigma);
+
+// Rows (and columns) of context conv_fastGaussian reads on each side.
+int conv_fastGaussianRadius(float sigma);
+
+// Splits kernel into kernelY[i] * kernelX[j] when that product reproduces
+// every weight exactly and every partial sum of either path is exact in a
+// double, so both paths give bit-identical results. Returns 1 on success.
+int conv_separate(const float* kernel, int size, float* kernelX, float* kernelY);
+
+#endif
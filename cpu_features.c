@@ -0,0 +1,64 @@
+#include "cpu_features.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static int detected = -1;
+static int cap = -1;
+
+static t_simdLevel detect(void) {
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("ssse3")) return SIMD_SSSE3;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+    return SIMD_SCALAR;
+#elif defined(CPU_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    int sse2 = (info[3] >> 26) & 1;
+    int ssse3 = (info[2] >> 9) & 1;
+    int osAvx = ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    if (osAvx && ((info[1] >> 5) & 1)) return SIMD_AVX2;
+    if (ssse3) return SIMD_SSSE3;
+    if (sse2) return SIMD_SSE2;
+    return SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+static int levelFromName(const char* name) {
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX2; level++) {
+        if (strcmp(name, cpu_simdName((t_simdLevel)level)) == 0) return level;
+    }
+    return -1;
+}
+
+t_simdLevel cpu_simdLevel(void) {
+    if (detected < 0) {
+        detected = detect();
+        const char* env = getenv("BMP_SIMD");
+        if (cap < 0 && env) cap = levelFromName(env);
+    }
+    if (cap >= 0 && cap < detected) return (t_simdLevel)cap;
+    return (t_simdLevel)detected;
+}
+
+void cpu_setSimdLevel(t_simdLevel level) {
+    cap = level;
+}
+
+const char* cpu_simdName(t_simdLevel level) {
+    switch (level) {
+        case SIMD_SSE2: return "sse2";
+        case SIMD_SSSE3: return "ssse3";
+        case SIMD_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
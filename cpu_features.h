@@ -0,0 +1,33 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86 1
+#endif
+
+// Per-function instruction set selection, so vector paths build without
+// global -m flags and are only entered after the runtime check.
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+typedef enum {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_SSSE3 = 2,
+    SIMD_AVX2 = 3
+} t_simdLevel;
+
+// Best instruction set the CPU supports, capped by cpu_setSimdLevel() or the
+// BMP_SIMD environment variable (scalar, sse2, ssse3 or avx2).
+t_simdLevel cpu_simdLevel(void);
+void cpu_setSimdLevel(t_simdLevel level);
+const char* cpu_simdName(t_simdLevel level);
+
+#endif
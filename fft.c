@@ -0,0 +1,341 @@
+#include "fft.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Transforms grow with the kernel but stop at MAX_TRANSFORM unless the
+// kernel itself needs more: the accumulator holds a transform's height of
+// double rows across the image.
+#define MIN_TRANSFORM 8
+#define MAX_TRANSFORM 256
+
+// Measured cost of one radix-2 butterfly and of the per-sample work around
+// the transforms (packing, spectrum product, accumulation), in direct-path
+// multiply-adds.
+#define BUTTERFLY_COST 3.3
+#define SAMPLE_COST 12.0
+
+typedef struct {
+    int n;                  // a power of two
+    int* reversed;          // bit-reversed index of each position
+    double* twiddles;       // cos and sin of -2 pi k / n for k < n / 2
+} t_fftPlan;
+
+static void planFree(t_fftPlan* plan) {
+    free(plan->reversed);
+    free(plan->twiddles);
+}
+
+static int planInit(t_fftPlan* plan, int n) {
+    plan->n = n;
+    plan->reversed = (int*)malloc(n * sizeof(int));
+    plan->twiddles = (double*)malloc(n * sizeof(double));
+    if (!plan->reversed || !plan->twiddles) {
+        planFree(plan);
+        return -1;
+    }
+    int bits = 0;
+    while ((1 << bits) < n) bits++;
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        plan->reversed[i] = r;
+    }
+    const double pi = 3.14159265358979323846;
+    for (int k = 0; k < n / 2; k++) {
+        plan->twiddles[2 * k] = cos(2 * pi * k / n);
+        plan->twiddles[2 * k + 1] = -sin(2 * pi * k / n);
+    }
+    return 0;
+}
+
+// In-place transform of n complex values stored as (re, im) pairs. The
+// inverse is unscaled.
+static void transform(double* x, const t_fftPlan* plan, int inverse) {
+    int n = plan->n;
+    for (int i = 0; i < n; i++) {
+        int j = plan->reversed[i];
+        if (i < j) {
+            double re = x[2 * i], im = x[2 * i + 1];
+            x[2 * i] = x[2 * j];
+            x[2 * i + 1] = x[2 * j + 1];
+            x[2 * j] = re;
+            x[2 * j + 1] = im;
+        }
+    }
+    double sign = inverse ? -1.0 : 1.0;
+    for (int half = 1; half < n; half *= 2) {
+        int step = n / (2 * half);
+        for (int start = 0; start < n; start += 2 * half) {
+            for (int k = 0; k < half; k++) {
+                double wr = plan->twiddles[2 * k * step];
+                double wi = sign * plan->twiddles[2 * k * step + 1];
+                double* a = x + 2 * (start + k);
+                double* b = a + 2 * half;
+                double tr = wr * b[0] - wi * b[1];
+                double ti = wr * b[1] + wi * b[0];
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+// Transforms every column of an n x n grid at once: each butterfly combines
+// two whole rows, so columns are never gathered.
+static void transformColumns(double* grid, const t_fftPlan* plan, int inverse, double* scratch) {
+    int n = plan->n;
+    size_t rowBytes = 2 * (size_t)n * sizeof(double);
+    for (int i = 0; i < n; i++) {
+        int j = plan->reversed[i];
+        if (i < j) {
+            memcpy(scratch, grid + 2 * (size_t)i * n, rowBytes);
+            memcpy(grid + 2 * (size_t)i * n, grid + 2 * (size_t)j * n, rowBytes);
+            memcpy(grid + 2 * (size_t)j * n, scratch, rowBytes);
+        }
+    }
+    double sign = inverse ? -1.0 : 1.0;
+    for (int half = 1; half < n; half *= 2) {
+        int step = n / (2 * half);
+        for (int start = 0; start < n; start += 2 * half) {
+            for (int k = 0; k < half; k++) {
+                double wr = plan->twiddles[2 * k * step];
+                double wi = sign * plan->twiddles[2 * k * step + 1];
+                double* a = grid + 2 * (size_t)(start + k) * n;
+                double* b = a + 2 * (size_t)half * n;
+                for (int c = 0; c < 2 * n; c += 2) {
+                    double tr = wr * b[c] - wi * b[c + 1];
+                    double ti = wr * b[c + 1] + wi * b[c];
+                    b[c] = a[c] - tr;
+                    b[c + 1] = a[c + 1] - ti;
+                    a[c] += tr;
+                    a[c + 1] += ti;
+                }
+            }
+        }
+    }
+}
+
+// Butterflies of a 2D transform pair (forward with rows rows of input, then
+// inverse) plus the per-sample work, for one complex tile.
+static double tileCost(int n, int rows) {
+    int bits = 0;
+    while ((1 << bits) < n) bits++;
+    double butterflies = (double)(rows + 3 * n) * (n / 2) * bits;
+    return butterflies * BUTTERFLY_COST + (double)n * n * SAMPLE_COST;
+}
+
+// Cheapest transform size for the image. Tiles of block = n - size + 1
+// samples are kept at least size - 1 wide, so the outputs of tiles two apart
+// never overlap and every other tile can be accumulated in parallel.
+static int transformSize(int width, int height, int size, double* costPerSample) {
+    int need = MIN_TRANSFORM;
+    while (need - size + 1 < (size - 1 > 1 ? size - 1 : 1)) need *= 2;
+
+    int best = need;
+    double bestCost = 0;
+    for (int n = need; n == need || n <= MAX_TRANSFORM; n *= 2) {
+        int block = n - size + 1;
+        double tiles = (double)((width + block - 1) / block) * ((height + block - 1) / block);
+        int rows = block < height ? block : height;
+        // Two real tiles share each complex transform.
+        double cost = tiles * tileCost(n, rows) / 2 / ((double)width * height);
+        if (n == need || cost < bestCost) {
+            best = n;
+            bestCost = cost;
+        }
+        if (block >= width && block >= height) break;
+    }
+    if (costPerSample) *costPerSample = bestCost;
+    return best;
+}
+
+double fft_cost(int width, int height, int size) {
+    double cost;
+    transformSize(width, height, size, &cost);
+    return cost;
+}
+
+typedef struct {
+    t_view* view;
+    const t_fftPlan* plan;
+    const double* spectrum;     // kernel spectrum, scaled by 1 / n^2
+    int size;
+    int block;                  // input samples per tile side
+    int strip;                  // first input row of the current strip
+    int parity;                 // tiles 0, 2, 4... or 1, 3, 5... in this phase
+    int jobs;                   // (tile, channel) pairs in this phase
+    double* acc;                // n rows of (width + size - 1) * channels sums
+    size_t accStride;
+} t_fftJob;
+
+static void jobTile(const t_fftJob* job, int j, int* tx, int* channel) {
+    int channels = job->view->channels;
+    *tx = (job->parity + 2 * (j / channels)) * job->block;
+    *channel = j % channels;
+}
+
+// Two jobs go through one complex transform, as its real and imaginary
+// parts: the kernel is real, so their results come back the same way.
+static void pairTask(void* context, int index) {
+    t_fftJob* job = (t_fftJob*)context;
+    const t_view* view = job->view;
+    int n = job->plan->n;
+    int c = view->channels;
+    double* grid = (double*)bufferPool_getZeroed((2 * (size_t)n * n + 2 * (size_t)n) * sizeof(double), 0);
+    if (!grid) return;
+    double* scratch = grid + 2 * (size_t)n * n;
+
+    int rows = view->height - job->strip < job->block ? view->height - job->strip : job->block;
+    for (int k = 0; k < 2 && 2 * index + k < job->jobs; k++) {
+        int tx, channel;
+        jobTile(job, 2 * index + k, &tx, &channel);
+        int cols = view->width - tx < job->block ? view->width - tx : job->block;
+        for (int r = 0; r < rows; r++) {
+            const unsigned char* src = view_row(view, job->strip + r) + (size_t)tx * c + channel;
+            double* dst = grid + 2 * (size_t)r * n + k;
+            for (int u = 0; u < cols; u++) {
+                dst[2 * u] = src[(size_t)u * c];
+            }
+        }
+    }
+
+    // Rows past the input are zero and stay zero through their transforms.
+    for (int r = 0; r < rows; r++) {
+        transform(grid + 2 * (size_t)r * n, job->plan, 0);
+    }
+    transformColumns(grid, job->plan, 0, scratch);
+    for (size_t i = 0; i < (size_t)n * n; i++) {
+        double re = grid[2 * i], im = grid[2 * i + 1];
+        double kr = job->spectrum[2 * i], ki = job->spectrum[2 * i + 1];
+        grid[2 * i] = re * kr - im * ki;
+        grid[2 * i + 1] = re * ki + im * kr;
+    }
+    transformColumns(grid, job->plan, 1, scratch);
+    for (int r = 0; r < n; r++) {
+        transform(grid + 2 * (size_t)r * n, job->plan, 1);
+    }
+
+    // Full correlation of the tile: row r, column u lands on acc row r and
+    // column tx + u, that is output pixel (tx + u - size / 2, strip + r - size / 2).
+    int fullRows = rows + job->size - 1;
+    for (int k = 0; k < 2 && 2 * index + k < job->jobs; k++) {
+        int tx, channel;
+        jobTile(job, 2 * index + k, &tx, &channel);
+        int cols = view->width - tx < job->block ? view->width - tx : job->block;
+        int fullCols = cols + job->size - 1;
+        for (int r = 0; r < fullRows; r++) {
+            double* accRow = job->acc + (size_t)r * job->accStride + (size_t)tx * c + channel;
+            const double* src = grid + 2 * (size_t)r * n + k;
+            for (int u = 0; u < fullCols; u++) {
+                accRow[(size_t)u * c] += src[2 * u];
+            }
+        }
+    }
+    bufferPool_release(grid);
+}
+
+static unsigned char toByte(double sum) {
+    if (sum > 255) sum = 255;
+    if (sum < 0) sum = 0;
+    return (unsigned char)sum;
+}
+
+// Kernel spectrum for correlation: the kernel flipped in both directions,
+// transformed, and scaled so that the inverse transform comes out normalized.
+static double* kernelSpectrum(const float* kernel, int size, const t_fftPlan* plan) {
+    int n = plan->n;
+    double* spectrum = (double*)bufferPool_getZeroed((2 * (size_t)n * n + 2 * (size_t)n) * sizeof(double), 0);
+    if (!spectrum) return NULL;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            spectrum[2 * ((size_t)(size - 1 - i) * n + (size - 1 - j))] = kernel[i * size + j];
+        }
+    }
+    for (int r = 0; r < size; r++) {
+        transform(spectrum + 2 * (size_t)r * n, plan, 0);
+    }
+    transformColumns(spectrum, plan, 0, spectrum + 2 * (size_t)n * n);
+    double scale = 1.0 / ((double)n * n);
+    for (size_t i = 0; i < 2 * (size_t)n * n; i++) {
+        spectrum[i] *= scale;
+    }
+    return spectrum;
+}
+
+void fft_convolve(t_view* view, const float* kernel, int size, t_edgeMode edge) {
+    if (!view || !view->data || !kernel || size <= 0 || size % 2 == 0) return;
+
+    int half = size / 2;
+    int c = view->channels;
+    int x0 = 0, x1 = view->width, y0 = 0, y1 = view->height;
+    if (edge == EDGE_UNTOUCHED) {
+        x0 = y0 = half;
+        x1 = view->width - half;
+        y1 = view->height - half;
+        if (x0 >= x1 || y0 >= y1) return;
+    }
+
+    t_fftPlan plan;
+    int n = transformSize(view->width, view->height, size, NULL);
+    if (planInit(&plan, n) != 0) return;
+    double* spectrum = kernelSpectrum(kernel, size, &plan);
+    size_t accStride = ((size_t)view->width + size - 1) * c;
+    double* acc = (double*)bufferPool_getZeroed((size_t)n * accStride * sizeof(double), 0);
+    if (!spectrum || !acc) {
+        bufferPool_release(spectrum);
+        bufferPool_release(acc);
+        planFree(&plan);
+        return;
+    }
+
+    t_fftJob job;
+    job.view = view;
+    job.plan = &plan;
+    job.spectrum = spectrum;
+    job.size = size;
+    job.block = n - size + 1;
+    job.acc = acc;
+    job.accStride = accStride;
+
+    double magnitude = 0;
+    for (int i = 0; i < size * size; i++) {
+        magnitude += fabs(kernel[i]);
+    }
+    double bias = 255 * magnitude * FFT_BIAS;
+    int tilesX = (view->width + job.block - 1) / job.block;
+
+    // Strips of block input rows. Once a strip is added, the block acc rows
+    // above its lowest contributions are final; they are written over input
+    // rows no later strip reads, and the remaining rows move up.
+    for (int strip = 0; strip - half < view->height; strip += job.block) {
+        job.strip = strip;
+        for (int parity = 0; parity < 2 && strip < view->height; parity++) {
+            job.parity = parity;
+            job.jobs = (tilesX - parity + 1) / 2 * c;
+            threadPool_parallelFor((job.jobs + 1) / 2, pairTask, &job);
+        }
+
+        for (int r = 0; r < job.block; r++) {
+            int y = strip - half + r;
+            if (y < y0 || y >= y1) continue;
+            const double* sums = acc + (size_t)r * accStride + (size_t)half * c;
+            unsigned char* out = view_row(view, y);
+            for (int k = x0 * c; k < x1 * c; k++) {
+                out[k] = toByte(sums[k] + bias);
+            }
+        }
+        memmove(acc, acc + (size_t)job.block * accStride, (size_t)(n - job.block) * accStride * sizeof(double));
+        memset(acc + (size_t)(n - job.block) * accStride, 0, (size_t)job.block * accStride * sizeof(double));
+    }
+
+    bufferPool_release(acc);
+    bufferPool_release(spectrum);
+    planFree(&plan);
+}
@@ -0,0 +1,24 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include "image_view.h"
+#include "convolution.h"
+
+// Same filter as conv_direct, computed with double-precision FFTs over
+// overlap-add tiles: O(log tile) per pixel whatever the kernel size. Each
+// channel is filtered on its own; two real tiles share one complex transform.
+//
+// Sums differ from the direct path by rounding only, far below FFT_BIAS
+// times the largest possible sum (255 times the absolute kernel weights).
+// They are nudged up by that much before truncation, so exact sums, integer
+// ones included, give the same byte; a sample can differ by one level only
+// when its exact sum lies that close below an integer.
+#define FFT_BIAS (1.0 / (1LL << 44))
+
+void fft_convolve(t_view* view, const float* kernel, int size, t_edgeMode edge);
+
+// Estimated cost of fft_convolve per output sample, in the units of one
+// multiply-add of the direct path, for the cost model in conv_filter.
+double fft_cost(int width, int height, int size);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "file_map.h"
+
+#ifdef _WIN32
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+void* file_map(const char* filename, size_t* size) {
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return NULL;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return NULL;
+
+    *size = (size_t)fileSize.QuadPart;
+    return view;
+}
+
+void file_unmap(void* mapping, size_t size) {
+    (void)size;
+    if (mapping) UnmapViewOfFile(mapping);
+}
+
+// No inode numbers here: the absolute paths are compared, ignoring case.
+int file_same(const char* a, const char* b) {
+    char fullA[_MAX_PATH], fullB[_MAX_PATH];
+    return _fullpath(fullA, a, sizeof(fullA)) && _fullpath(fullB, b, sizeof(fullB)) &&
+           _stricmp(fullA, fullB) == 0;
+}
+
+#else
+
+void* file_map(const char* filename, size_t* size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    *size = (size_t)st.st_size;
+    return mapping;
+}
+
+void file_unmap(void* mapping, size_t size) {
+    if (mapping) munmap(mapping, size);
+}
+
+int file_same(const char* a, const char* b) {
+    struct stat infoA, infoB;
+    return stat(a, &infoA) == 0 && stat(b, &infoB) == 0 &&
+           infoA.st_dev == infoB.st_dev && infoA.st_ino == infoB.st_ino;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+#include <stddef.h>
+
+// Maps a whole file copy-on-write: pages are shared with the page cache until
+// written, and writes never reach the file. Returns NULL on failure.
+void* file_map(const char* filename, size_t* size);
+void file_unmap(void* mapping, size_t size);
+
+// Whether both paths name one existing file, links and ./.. spellings
+// included. Saving over a file that is still mapped truncates the mapping.
+int file_same(const char* a, const char* b);
+
+#endif
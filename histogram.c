@@ -0,0 +1,132 @@
+#include "histogram.h"
+#include "buffer_pool.h"
+#include "pixel_format.h"
+#include "thread_pool.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Each band covers at least HISTOGRAM_CHUNK bytes.
+#define HISTOGRAM_CHUNK (1 << 16)
+
+void histogram_add(const unsigned char* data, size_t count, unsigned int hist[256]) {
+    unsigned int copies[HISTOGRAM_COPIES][256];
+    memset(copies, 0, sizeof(copies));
+
+    size_t i = 0;
+    for (; i + HISTOGRAM_COPIES <= count; i += HISTOGRAM_COPIES) {
+        copies[0][data[i]]++;
+        copies[1][data[i + 1]]++;
+        copies[2][data[i + 2]]++;
+        copies[3][data[i + 3]]++;
+    }
+    for (; i < count; i++) {
+        copies[0][data[i]]++;
+    }
+
+    for (int v = 0; v < 256; v++) {
+        hist[v] += copies[0][v] + copies[1][v] + copies[2][v] + copies[3][v];
+    }
+}
+
+// Interleaved pixels: sample x * channels + c goes to channel c, copy
+// x % HISTOGRAM_COPIES. Only the copies of the channels present are cleared.
+static ALWAYS_INLINE void addInterleaved(const unsigned char* data, size_t pixels, int channels,
+                                         unsigned int (*hist)[256]) {
+    unsigned int copies[HISTOGRAM_COPIES * PIXEL_MAX_CHANNELS][256];
+    memset(copies, 0, (size_t)HISTOGRAM_COPIES * channels * sizeof(copies[0]));
+
+    size_t x = 0;
+    for (; x + HISTOGRAM_COPIES <= pixels; x += HISTOGRAM_COPIES) {
+        const unsigned char* px = data + x * channels;
+        PIXEL_UNROLL for (int k = 0; k < HISTOGRAM_COPIES; k++) {
+            PIXEL_UNROLL for (int c = 0; c < channels; c++) {
+                copies[k * channels + c][px[k * channels + c]]++;
+            }
+        }
+    }
+    for (; x < pixels; x++) {
+        PIXEL_UNROLL for (int c = 0; c < channels; c++) {
+            copies[c][data[x * channels + c]]++;
+        }
+    }
+
+    for (int c = 0; c < channels; c++) {
+        for (int v = 0; v < 256; v++) {
+            unsigned int sum = 0;
+            for (int k = 0; k < HISTOGRAM_COPIES; k++) {
+                sum += copies[k * channels + c][v];
+            }
+            hist[c][v] += sum;
+        }
+    }
+}
+
+static void addPixels(const unsigned char* data, size_t pixels, int channels, unsigned int (*hist)[256]) {
+    if (channels == PIXEL_GRAY8) {
+        histogram_add(data, pixels, hist[0]);
+        return;
+    }
+    PIXEL_DISPATCH(channels, addInterleaved(data, pixels, PIXEL_CHANNELS, hist));
+}
+
+typedef struct {
+    const t_view* view;
+    int bands;
+    int contiguous;             // rows follow each other without padding
+    const unsigned char* first; // lowest-addressed row
+    unsigned int* partial;      // bands x channels x 256
+} t_histogramJob;
+
+static void histogramBand(void* context, int index) {
+    t_histogramJob* job = (t_histogramJob*)context;
+    const t_view* view = job->view;
+    unsigned int (*hist)[256] = (unsigned int (*)[256])(job->partial + (size_t)256 * view->channels * index);
+
+    if (job->contiguous) {
+        size_t pixels = (size_t)view->width * view->height;
+        size_t begin = pixels * index / job->bands;
+        size_t end = pixels * (index + 1) / job->bands;
+        addPixels(job->first + begin * view->channels, end - begin, view->channels, hist);
+        return;
+    }
+    int y0 = (int)((long long)view->height * index / job->bands);
+    int y1 = (int)((long long)view->height * (index + 1) / job->bands);
+    for (int y = y0; y < y1; y++) {
+        addPixels(view_row(view, y), (size_t)view->width, view->channels, hist);
+    }
+}
+
+int histogram_view(const t_view* view, unsigned int (*hist)[256]) {
+    if (!view || !view->data || !hist || view->channels < 1) return -1;
+    memset(hist, 0, (size_t)view->channels * sizeof(hist[0]));
+    if (view->width <= 0 || view->height <= 0) return 0;
+
+    int rowLen = view->width * view->channels;
+    t_histogramJob job;
+    job.view = view;
+    job.contiguous = view->stride == rowLen || view->stride == -rowLen;
+    job.first = view->stride < 0 ? view_row(view, view->height - 1) : view->data;
+    if (job.contiguous) {
+        long long bytes = (long long)rowLen * view->height;
+        job.bands = threadPool_bandCount(bytes > INT_MAX ? INT_MAX : (int)bytes, HISTOGRAM_CHUNK);
+    } else {
+        int minRows = HISTOGRAM_CHUNK / rowLen > 0 ? HISTOGRAM_CHUNK / rowLen : 1;
+        job.bands = threadPool_bandCount(view->height, minRows);
+    }
+
+    job.partial = (unsigned int*)bufferPool_getZeroed((size_t)256 * view->channels * job.bands * sizeof(unsigned int), 0);
+    if (!job.partial) return -1;
+    threadPool_parallelFor(job.bands, histogramBand, &job);
+
+    const unsigned int* partial = job.partial;
+    for (int b = 0; b < job.bands; b++) {
+        for (int c = 0; c < view->channels; c++) {
+            for (int v = 0; v < 256; v++) {
+                hist[c][v] += *partial++;
+            }
+        }
+    }
+    bufferPool_release(job.partial);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "image_view.h"
+
+// Counts are spread over HISTOGRAM_COPIES interleaved sub-histograms so that
+// runs of equal samples (flat scan backgrounds) do not serialize on one
+// counter; the copies are summed at the end.
+#define HISTOGRAM_COPIES 4
+
+// Adds the samples of data[0 .. count) to hist.
+void histogram_add(const unsigned char* data, size_t count, unsigned int hist[256]);
+
+// Per-channel histograms of a view: hist[c][v] counts the samples of value v
+// in channel c (memory order). Bands run on the thread pool, each into its own
+// counters, and are merged in a fixed order. Returns 0, or -1 when out of
+// memory.
+int histogram_view(const t_view* view, unsigned int (*hist)[256]);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <stddef.h>
+
+// Borrowed view of interleaved 8-bit samples, shared by the bmp8 and bmp24
+// processing cores. A bmp8 image is a view with one channel, a bmp24 image a
+// view with three, and the channel count names the pixel format (see
+// pixel_format.h); rows may run bottom-up (negative stride).
+typedef struct {
+    unsigned char* data;   // first sample of row 0
+    int width;             // pixels per row
+    int height;
+    int stride;            // signed byte distance from row y to row y + 1
+    int channels;          // interleaved samples per pixel
+} t_view;
+
+static inline unsigned char* view_row(const t_view* view, int y) {
+    return view->data + (ptrdiff_t)y * view->stride;
+}
+
+#endif
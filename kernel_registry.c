@@ -0,0 +1,107 @@
+#include "kernel_registry.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUILTIN_WEIGHTS(NAME, label, t00, t01, t02, t10, t11, t12, t20, t21, t22, divisor) \
+    static const float WEIGHTS_##NAME[9] = { \
+        (float)t00 / divisor, (float)t01 / divisor, (float)t02 / divisor, \
+        (float)t10 / divisor, (float)t11 / divisor, (float)t12 / divisor, \
+        (float)t20 / divisor, (float)t21 / divisor, (float)t22 / divisor \
+    };
+CONV3X3_BUILTINS(BUILTIN_WEIGHTS)
+
+#define BUILTIN_ENTRY(NAME, label, ...) { label, 3, WEIGHTS_##NAME, &KERNEL3_##NAME },
+#define BUILTIN_COUNT(...) + 1
+
+// Entries are only ever appended, so pointers handed out stay valid.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static t_kernel kernels[MAX_KERNELS] = {
+    CONV3X3_BUILTINS(BUILTIN_ENTRY)
+};
+static int kernelCount = 0 CONV3X3_BUILTINS(BUILTIN_COUNT);
+
+static const t_kernel* findLocked(const char* name) {
+    for (int k = 0; k < kernelCount; k++) {
+        if (strcmp(kernels[k].name, name) == 0) return &kernels[k];
+    }
+    return NULL;
+}
+
+const t_kernel* kernelRegistry_find(const char* name) {
+    if (!name) return NULL;
+
+    pthread_mutex_lock(&lock);
+    const t_kernel* kernel = findLocked(name);
+    pthread_mutex_unlock(&lock);
+    return kernel;
+}
+
+int kernelRegistry_register(const char* name, const float* weights, int size) {
+    if (!name || !weights) return -1;
+    if (size <= 0 || size % 2 == 0) {
+        printf("Error: Kernel size must be odd, got %d\n", size);
+        return -1;
+    }
+
+    size_t nameLength = strlen(name) + 1;
+    char* nameCopy = (char*)malloc(nameLength);
+    float* weightsCopy = (float*)malloc((size_t)size * size * sizeof(float));
+    if (!nameCopy || !weightsCopy) {
+        printf("Error: Memory allocation failed\n");
+        free(nameCopy);
+        free(weightsCopy);
+        return -1;
+    }
+    memcpy(nameCopy, name, nameLength);
+    memcpy(weightsCopy, weights, (size_t)size * size * sizeof(float));
+
+    pthread_mutex_lock(&lock);
+    const char* error = NULL;
+    if (findLocked(name)) {
+        error = "is already registered";
+    } else if (kernelCount >= MAX_KERNELS) {
+        error = "does not fit, the registry is full";
+    } else {
+        t_kernel* kernel = &kernels[kernelCount];
+        kernel->name = nameCopy;
+        kernel->size = size;
+        kernel->weights = weightsCopy;
+        kernel->fixed = NULL;
+        kernelCount++;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (error) {
+        printf("Error: Kernel %s %s\n", name, error);
+        free(nameCopy);
+        free(weightsCopy);
+        return -1;
+    }
+    return 0;
+}
+
+int kernelRegistry_count(void) {
+    pthread_mutex_lock(&lock);
+    int count = kernelCount;
+    pthread_mutex_unlock(&lock);
+    return count;
+}
+
+const t_kernel* kernelRegistry_at(int index) {
+    pthread_mutex_lock(&lock);
+    const t_kernel* kernel = index >= 0 && index < kernelCount ? &kernels[index] : NULL;
+    pthread_mutex_unlock(&lock);
+    return kernel;
+}
+
+void kernelRegistry_apply(t_view* view, const t_kernel* kernel, t_edgeMode edge) {
+    if (!view || !kernel) return;
+
+    if (kernel->fixed) {
+        conv3x3_apply(view, kernel->fixed, edge);
+    } else {
+        conv_filter(view, kernel->weights, kernel->size, edge);
+    }
+}
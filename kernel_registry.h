@@ -0,0 +1,31 @@
+#ifndef KERNEL_REGISTRY_H
+#define KERNEL_REGISTRY_H
+
+#include "conv3x3.h"
+#include "convolution.h"
+
+// Convolution kernels looked up by name. The built-ins come from
+// CONV3X3_BUILTINS and run their specialized 3x3 rows; kernels registered at
+// run time go through conv_filter.
+typedef struct {
+    const char* name;
+    int size;                       // odd
+    const float* weights;           // size x size, row-major
+    const t_fixedKernel* fixed;     // built-ins only, else NULL
+} t_kernel;
+
+#define MAX_KERNELS 64
+
+// NULL when no kernel has that name.
+const t_kernel* kernelRegistry_find(const char* name);
+
+// Copies name and weights. Returns 0, or -1 (after printing why) when the
+// size is not odd, the name is taken or the registry is full.
+int kernelRegistry_register(const char* name, const float* weights, int size);
+
+int kernelRegistry_count(void);
+const t_kernel* kernelRegistry_at(int index);
+
+void kernelRegistry_apply(t_view* view, const t_kernel* kernel, t_edgeMode edge);
+
+#endif
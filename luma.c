@@ -0,0 +1,111 @@
+#include "luma.h"
+#include "pixel_format.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Rounded luma of count pixels into luma[].
+static void lumaScalar(const unsigned char* pixels, int channels, unsigned char* luma, int count) {
+    for (int x = 0; x < count; x++) {
+        const unsigned char* px = pixels + channels * x;
+        luma[x] = (unsigned char)((LUMA_BLUE * px[0] + LUMA_GREEN * px[1] + LUMA_RED * px[2] + 16384) >> 15);
+    }
+}
+
+#ifdef CPU_X86
+
+// Byte shuffles between 16 interleaved BGR pixels (three vectors) and planes:
+// plane c takes bytes 3j + c - 16s from source vector s.
+TARGET_SSSE3 static void planeMasks(__m128i masks[3][3]) {
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 3; v++) {
+            char bytes[16];
+            for (int j = 0; j < 16; j++) {
+                int index = 3 * j + c - 16 * v;
+                bytes[j] = (char)(index >= 0 && index < 16 ? index : 0x80);
+            }
+            masks[c][v] = _mm_loadu_si128((const __m128i*)bytes);
+        }
+    }
+}
+
+TARGET_SSSE3 static void lumaSSSE3(const unsigned char* pixels, unsigned char* luma, int count) {
+    __m128i masks[3][3];
+    planeMasks(masks);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i redGreen = _mm_set1_epi32(LUMA_RED | (LUMA_GREEN << 16));
+    const __m128i blueRound = _mm_set1_epi32(LUMA_BLUE | (16384 << 16));
+    const __m128i one = _mm_set1_epi16(1);
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        const unsigned char* px = pixels + 3 * x;
+        __m128i v0 = _mm_loadu_si128((const __m128i*)px);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(px + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(px + 32));
+        __m128i plane[3];
+        for (int c = 0; c < 3; c++) {
+            plane[c] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, masks[c][0]),
+                                                 _mm_shuffle_epi8(v1, masks[c][1])),
+                                    _mm_shuffle_epi8(v2, masks[c][2]));
+        }
+
+        __m128i sums[4];
+        for (int half = 0; half < 2; half++) {
+            __m128i b = half ? _mm_unpackhi_epi8(plane[0], zero) : _mm_unpacklo_epi8(plane[0], zero);
+            __m128i g = half ? _mm_unpackhi_epi8(plane[1], zero) : _mm_unpacklo_epi8(plane[1], zero);
+            __m128i r = half ? _mm_unpackhi_epi8(plane[2], zero) : _mm_unpacklo_epi8(plane[2], zero);
+            __m128i lowRG = _mm_madd_epi16(_mm_unpacklo_epi16(r, g), redGreen);
+            __m128i highRG = _mm_madd_epi16(_mm_unpackhi_epi16(r, g), redGreen);
+            __m128i lowB = _mm_madd_epi16(_mm_unpacklo_epi16(b, one), blueRound);
+            __m128i highB = _mm_madd_epi16(_mm_unpackhi_epi16(b, one), blueRound);
+            sums[2 * half] = _mm_srli_epi32(_mm_add_epi32(lowRG, lowB), 15);
+            sums[2 * half + 1] = _mm_srli_epi32(_mm_add_epi32(highRG, highB), 15);
+        }
+        __m128i words = _mm_packs_epi32(sums[0], sums[1]);
+        __m128i words2 = _mm_packs_epi32(sums[2], sums[3]);
+        _mm_storeu_si128((__m128i*)(luma + x), _mm_packus_epi16(words, words2));
+    }
+    lumaScalar(pixels + 3 * x, PIXEL_BGR24, luma + x, count - x);
+}
+
+// BGRX pixels need no shuffles: widened to words, one multiply-add gives
+// B + G and R (+ 0 * X) per pixel, and a horizontal add joins the pair.
+TARGET_SSSE3 static void lumaBGRXSSSE3(const unsigned char* pixels, unsigned char* luma, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(LUMA_BLUE, LUMA_GREEN, LUMA_RED, 0, LUMA_BLUE, LUMA_GREEN, LUMA_RED, 0);
+    const __m128i round = _mm_set1_epi32(16384);
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i sums[4];
+        for (int v = 0; v < 4; v++) {
+            __m128i px = _mm_loadu_si128((const __m128i*)(pixels + 4 * x + 16 * v));
+            __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), weights);
+            __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), weights);
+            sums[v] = _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(low, high), round), 15);
+        }
+        __m128i words = _mm_packs_epi32(sums[0], sums[1]);
+        __m128i words2 = _mm_packs_epi32(sums[2], sums[3]);
+        _mm_storeu_si128((__m128i*)(luma + x), _mm_packus_epi16(words, words2));
+    }
+    lumaScalar(pixels + 4 * x, PIXEL_BGRX32, luma + x, count - x);
+}
+
+#endif
+
+void luma_row(const unsigned char* pixels, int channels, unsigned char* luma, int count, t_simdLevel level) {
+#ifdef CPU_X86
+    if (level >= SIMD_SSSE3) {
+        if (channels == PIXEL_BGRX32) {
+            lumaBGRXSSSE3(pixels, luma, count);
+        } else {
+            lumaSSSE3(pixels, luma, count);
+        }
+        return;
+    }
+#endif
+    (void)level;
+    lumaScalar(pixels, channels, luma, count);
+}
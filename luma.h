@@ -0,0 +1,17 @@
+#ifndef LUMA_H
+#define LUMA_H
+
+#include "cpu_features.h"
+
+// Luma in 15-bit fixed point: 0.299, 0.587 and 0.114 scaled by 32768, which
+// sum to exactly 32768 so white stays 255, and each fit a signed 16-bit lane.
+#define LUMA_RED 9798
+#define LUMA_GREEN 19235
+#define LUMA_BLUE 3735
+
+// Rounded luma of count interleaved pixels into luma[], 16 pixels per step
+// from SSSE3 up; every level gives the same bytes. channels is PIXEL_BGR24 or
+// PIXEL_BGRX32 (whose fourth byte is ignored).
+void luma_row(const unsigned char* pixels, int channels, unsigned char* luma, int count, t_simdLevel level);
+
+#endif
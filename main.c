@@ -1,166 +1,485 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "batch.h"
 #include "bmp8.h"
 #include "bmp24.h"
-#include "Histogram_equalization.h"
+#include "buffer_pool.h"
+#include "file_map.h"
+#include "operations.h"
+#include "server.h"
+#include "stream.h"
+#include "thread_pool.h"
+#include "timing.h"
+#include "trace.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
-#include <windows.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define PATH_SEPARATORS "/\\"
+#ifndef S_ISDIR
+#define S_ISDIR(mode) (((mode) & _S_IFMT) == _S_IFDIR)
+#endif
+#else
+#include <dirent.h>
+#include <glob.h>
+#define PATH_SEPARATORS "/"
+#endif
 
-int _8bit(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    unsigned char header[54];
-    fread(header, 1, 54, file);
-    unsigned int colorDepth = *(unsigned int*)&header[28];
-    fclose(file);
-    if (colorDepth == 8) {
-        return 1;
-    } else if (colorDepth == 24) {
-        return 0;
+// Growable list of input paths for batch mode.
+typedef struct {
+    char** paths;
+    int count;
+    int capacity;
+} t_fileList;
+
+static int fileList_add(t_fileList* list, const char* path) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        char** paths = (char**)realloc(list->paths, capacity * sizeof(char*));
+        if (!paths) return -1;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    size_t length = strlen(path) + 1;
+    char* copy = (char*)malloc(length);
+    if (!copy) return -1;
+    memcpy(copy, path, length);
+    list->paths[list->count++] = copy;
+    return 0;
+}
+
+static void fileList_free(t_fileList* list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->paths[i]);
     }
+    free(list->paths);
+}
+
+static int hasBmpExtension(const char* name) {
+    size_t length = strlen(name);
+    if (length < 4) return 0;
+    const char* ext = name + length - 4;
+    return ext[0] == '.' && (ext[1] | 0x20) == 'b' && (ext[2] | 0x20) == 'm' && (ext[3] | 0x20) == 'p';
+}
+
+static int isDirectory(const char* path) {
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static int compareStrings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
 }
 
+#ifdef _WIN32
+
+// pattern may contain wildcards; matches are joined onto its directory part.
+static int addMatches(t_fileList* list, const char* pattern, int bmpOnly) {
+    struct _finddata_t found;
+    intptr_t handle = _findfirst(pattern, &found);
+    if (handle == -1) return 0;
 
+    size_t dirLength = 0;
+    for (size_t i = 0; pattern[i]; i++) {
+        if (strchr(PATH_SEPARATORS, pattern[i])) dirLength = i + 1;
+    }
+    int added = 0;
+    do {
+        if (found.attrib & _A_SUBDIR) continue;
+        if (bmpOnly && !hasBmpExtension(found.name)) continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%.*s%s", (int)dirLength, pattern, found.name);
+        if (fileList_add(list, path) != 0) break;
+        added++;
+    } while (_findnext(handle, &found) == 0);
+    _findclose(handle);
+    return added;
+}
 
-int main(void) {
-    t_bmp8* image8 = NULL;
-    t_bmp24* image24 = NULL;
+static int addDirectory(t_fileList* list, const char* dir) {
+    char pattern[1024];
+    snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+    return addMatches(list, pattern, 1);
+}
+
+static int addPattern(t_fileList* list, const char* pattern) {
+    return addMatches(list, pattern, 0);
+}
+
+static int makeDirectory(const char* path) {
+    return _mkdir(path);
+}
+
+#else
+
+static int addDirectory(t_fileList* list, const char* dir) {
+    DIR* handle = opendir(dir);
+    if (!handle) return 0;
+
+    int first = list->count;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (!hasBmpExtension(entry->d_name)) continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (isDirectory(path) || fileList_add(list, path) != 0) continue;
+    }
+    closedir(handle);
+
+    // readdir order is arbitrary; keep runs reproducible.
+    qsort(list->paths + first, list->count - first, sizeof(char*), compareStrings);
+    return list->count - first;
+}
+
+static int addPattern(t_fileList* list, const char* pattern) {
+    glob_t matches;
+    if (glob(pattern, 0, NULL, &matches) != 0) return 0;
+
+    int added = 0;
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+        if (isDirectory(matches.gl_pathv[i])) continue;
+        if (fileList_add(list, matches.gl_pathv[i]) != 0) break;
+        added++;
+    }
+    globfree(&matches);
+    return added;
+}
+
+static int makeDirectory(const char* path) {
+    return mkdir(path, 0777);
+}
+
+#endif
+
+// An input is a directory (all *.bmp inside), a wildcard pattern, or a file.
+static int addInput(t_fileList* list, const char* input) {
+    if (isDirectory(input)) return addDirectory(list, input);
+    if (strpbrk(input, "*?[")) return addPattern(list, input);
+    return fileList_add(list, input) == 0 ? 1 : 0;
+}
+
+static const char* baseName(const char* path) {
+    const char* name = path;
+    for (const char* p = path; *p; p++) {
+        if (strchr(PATH_SEPARATORS, *p)) name = p + 1;
+    }
+    return name;
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s -p OPERATIONS -o OUTPUT_DIR [-t THREADS] [-q IMAGES] [-m | -s ROWS | -c SOCKET] [-x] [-T TRACE] INPUT...\n", program);
+    printf("       %s -S SOCKET [-t THREADS] [-m] [-x] [-T TRACE]\n", program);
+    printf("       %s             (no arguments: interactive menu)\n\n", program);
+    printf("INPUT is a .bmp file, a directory of .bmp files, or a quoted wildcard pattern.\n");
+    printf("OPERATIONS is a comma-separated list applied in order, e.g. brightness=20,negative.\n");
+    printf("Each result is saved as OUTPUT_DIR/<input file name>; inputs that would share an output\n");
+    printf("or overwrite themselves fail without running.\n");
+    printf("  -t THREADS  worker threads (default: one per core)\n");
+    printf("  -q IMAGES   images held at once by the load, process and save stages (default: 3)\n");
+    printf("  -m          load images through copy-on-write file mappings\n");
+    printf("  -x          process 24-bit images as 4-byte BGRX pixels, converted after loading\n");
+    printf("              and back when saving (see bench for what it costs and gains)\n");
+    printf("  -s ROWS     stream images in strips of ROWS rows instead of loading them whole\n");
+    printf("  -S SOCKET   serve jobs on the Unix socket SOCKET until interrupted\n");
+    printf("  -c SOCKET   send the jobs to a server started with -S instead of running them\n");
+    printf("  -T TRACE    record every stage to TRACE in Chrome trace_event JSON\n");
+    printf("              (BMP_TRACE=TRACE does the same, for the interactive menu too)\n\n");
+    printf("Operations:\n");
+    op_printUsage(stdout);
+}
+
+static int compareOutputs(const void* a, const void* b) {
+    return strcmp((*(t_batchItem* const*)a)->output, (*(t_batchItem* const*)b)->output);
+}
+
+// Fails, before anything runs, every item whose output would overwrite its
+// own input (e.g. -o naming the input directory) or is shared with another
+// item (inputs from different directories with the same name), rather than
+// let one result silently replace another. Returns the number failed.
+static int rejectCollisions(t_batchItem* items, int count) {
+    t_batchItem** sorted = (t_batchItem**)malloc((count > 0 ? count : 1) * sizeof(t_batchItem*));
+    if (!sorted) return 0;
+    for (int i = 0; i < count; i++) sorted[i] = &items[i];
+    qsort(sorted, count, sizeof(t_batchItem*), compareOutputs);
+    for (int i = 0; i + 1 < count; i++) {
+        if (strcmp(sorted[i]->output, sorted[i + 1]->output) != 0) continue;
+        snprintf(sorted[i]->error, sizeof(sorted[i]->error), "output %.120s is also another input's output",
+                 sorted[i]->output);
+        snprintf(sorted[i + 1]->error, sizeof(sorted[i + 1]->error), "output %.120s is also another input's output",
+                 sorted[i + 1]->output);
+    }
+    free(sorted);
+
+    int rejected = 0;
+    for (int i = 0; i < count; i++) {
+        if (!items[i].error[0] && file_same(items[i].input, items[i].output)) {
+            snprintf(items[i].error, sizeof(items[i].error), "output would overwrite the input");
+        }
+        if (items[i].error[0]) rejected++;
+    }
+    return rejected;
+}
+
+// Runs ops strip by strip from input to output, for images larger than memory.
+static void processStreamed(t_batchItem* item, const t_operation* ops, int opCount, int stripRows) {
+    t_streamStats stats;
+    double start = timing_now();
+    item->pixels = 0;
+    item->error[0] = '\0';
+    if (stream_process(item->input, item->output, ops, opCount, stripRows, &stats) != 0) {
+        snprintf(item->error, sizeof(item->error), "streaming failed");
+    } else {
+        item->pixels = (double)stats.width * stats.height;
+    }
+    item->seconds = timing_now() - start;
+}
+
+// Prints one line per finished file, in input order.
+static void reportItem(void* context, const t_batchItem* item) {
+    (void)context;
+    if (!item->error[0] && item->loadSeconds + item->processSeconds + item->saveSeconds > 0) {
+        printf("ok     %s -> %s (%.1f ms: load %.1f, process %.1f, save %.1f)\n", item->input, item->output,
+               item->seconds * 1e3, item->loadSeconds * 1e3, item->processSeconds * 1e3, item->saveSeconds * 1e3);
+    } else if (!item->error[0]) {
+        printf("ok     %s -> %s (%.1f ms)\n", item->input, item->output, item->seconds * 1e3);
+    } else {
+        printf("FAILED %s: %s\n", item->input, item->error);
+    }
+}
+
+// Returns 0 when every file was processed, 1 when any failed, 2 on bad usage.
+static int runBatch(int argc, char** argv) {
+    const char* opText = NULL;
+    const char* outputDir = NULL;
+    int loadFlags = 0;
+    int stripRows = 0;
+    int inFlight = 0;
+    const char* serveSocket = NULL;
+    const char* clientSocket = NULL;
+    t_fileList inputs = { NULL, 0, 0 };
+    int status = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            printUsage(argv[0]);
+            fileList_free(&inputs);
+            return 0;
+        } else if (strcmp(arg, "-p") == 0 && i + 1 < argc) {
+            opText = argv[++i];
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            outputDir = argv[++i];
+        } else if (strcmp(arg, "-t") == 0 && i + 1 < argc) {
+            threadPool_setThreadCount(atoi(argv[++i]));
+        } else if (strcmp(arg, "-m") == 0) {
+            loadFlags |= LOAD_MAPPED;
+        } else if (strcmp(arg, "-x") == 0) {
+            loadFlags |= LOAD_BGRX;
+        } else if (strcmp(arg, "-s") == 0 && i + 1 < argc) {
+            stripRows = atoi(argv[++i]);
+            if (stripRows <= 0) {
+                printf("Error: -s needs a positive number of rows\n");
+                status = 2;
+            }
+        } else if (strcmp(arg, "-q") == 0 && i + 1 < argc) {
+            inFlight = atoi(argv[++i]);
+            if (inFlight <= 0) {
+                printf("Error: -q needs a positive number of images\n");
+                status = 2;
+            }
+        } else if (strcmp(arg, "-S") == 0 && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (strcmp(arg, "-c") == 0 && i + 1 < argc) {
+            clientSocket = argv[++i];
+        } else if (strcmp(arg, "-T") == 0 && i + 1 < argc) {
+            if (trace_start(argv[++i]) != 0) status = 2;
+        } else if (arg[0] == '-') {
+            printf("Error: Unknown or incomplete option %s\n", arg);
+            status = 2;
+        } else if (addInput(&inputs, arg) == 0) {
+            printf("Error: No input files match %s\n", arg);
+            status = 1;
+        }
+    }
+
+    if (serveSocket && status != 2) {
+        fileList_free(&inputs);
+        return server_run(serveSocket, loadFlags) == 0 ? 0 : 1;
+    }
+    if (clientSocket && stripRows > 0) {
+        printf("Error: -c and -s cannot be combined\n");
+        status = 2;
+    }
+    if ((loadFlags & LOAD_BGRX) && (clientSocket || stripRows > 0)) {
+        printf("Error: -x cannot be combined with -s or -c (start the server with -x instead)\n");
+        status = 2;
+    }
+
+    t_operation ops[MAX_OPERATIONS];
+    int opCount = opText ? op_parseList(opText, ops, MAX_OPERATIONS) : -1;
+    if (!opText || !outputDir || opCount < 0 || status == 2) {
+        if (!opText || !outputDir) printUsage(argv[0]);
+        fileList_free(&inputs);
+        return 2;
+    }
+    if (!isDirectory(outputDir) && makeDirectory(outputDir) != 0) {
+        printf("Error: Cannot create output directory %s\n", outputDir);
+        fileList_free(&inputs);
+        return 2;
+    }
+
+    t_batchItem* items = (t_batchItem*)calloc(inputs.count > 0 ? inputs.count : 1, sizeof(t_batchItem));
+    char (*outputs)[1024] = calloc(inputs.count > 0 ? inputs.count : 1, sizeof(*outputs));
+    if (!items || !outputs) {
+        printf("Error: Memory allocation failed\n");
+        free(items);
+        free(outputs);
+        fileList_free(&inputs);
+        return 1;
+    }
+    for (int f = 0; f < inputs.count; f++) {
+        snprintf(outputs[f], sizeof(outputs[f]), "%s/%s", outputDir, baseName(inputs.paths[f]));
+        items[f].input = inputs.paths[f];
+        items[f].output = outputs[f];
+    }
+
+    // Rejected items are reported first; the rest move up and run.
+    int failed = rejectCollisions(items, inputs.count);
+    int count = 0;
+    for (int f = 0; f < inputs.count; f++) {
+        if (items[f].error[0]) reportItem(NULL, &items[f]);
+        else items[count++] = items[f];
+    }
+
+    double start = timing_now();
+    if (stripRows > 0) {
+        for (int f = 0; f < count; f++) {
+            processStreamed(&items[f], ops, opCount, stripRows);
+            reportItem(NULL, &items[f]);
+            if (items[f].error[0]) failed++;
+        }
+    } else if (clientSocket) {
+        int submitFailed = count > 0 ? server_submit(clientSocket, items, count, opText, reportItem, NULL) : 0;
+        failed += submitFailed < 0 ? count : submitFailed;
+    } else {
+        failed += batch_run(items, count, ops, opCount, loadFlags, inFlight, reportItem, NULL);
+    }
+    double elapsed = timing_now() - start;
+
+    double pixels = 0;
+    for (int f = 0; f < count; f++) pixels += items[f].pixels;
+    int done = inputs.count - failed;
+    printf("%d image(s) processed, %d failed in %.3f s: %.2f images/sec, %.1f Mpixel/sec\n",
+           done, failed, elapsed,
+           elapsed > 0 ? done / elapsed : 0.0,
+           elapsed > 0 ? pixels / elapsed / 1e6 : 0.0);
+
+    // With -c the buffers belong to the server.
+    if (!clientSocket) {
+        t_poolStats pool;
+        bufferPool_stats(&pool);
+        printf("buffer pool: %.1f MB high-water, %lu of %lu requests reused\n",
+               pool.highWater / 1048576.0, pool.reused, pool.reused + pool.allocated);
+    }
+
+    free(outputs);
+    free(items);
+    fileList_free(&inputs);
+    return failed || status ? 1 : 0;
+}
+
+static void applyFromMenu(t_image* image, t_opType type, float value) {
+    t_operation op = { type, value };
+    if (op_apply(image, &op) == 0) {
+        printf("Filter applied successfully !\n");
+    } else {
+        printf("This filter is not available for this image\n");
+    }
+}
+
+static void runMenu(void) {
+    t_image image = { NULL, NULL };
     int choice = 0;
     while (choice != 6) {
         printf("Please choose an option:\n  1. Open an image\n  2. Save an image\n  3. Apply a filter\n  4. Display image information\n  5. Equalize Historigram\n  6. Quit\n>>> Your choice : ");
         if (scanf(" %d", &choice) != 1) {
+            if (feof(stdin)) break;
             printf("Invalid input! Please enter a number.\n");
-            while (getchar() != '\n') {
-                choice = 0;
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF) {
             }
+            choice = 0;
+            continue;
         }
         switch (choice) {
-            case 1:
+            case 1: {
                 char path[256];
                 printf("File path: ");
-                scanf(" %255[^\n]", path);
-                if (image8) {
-                    free(image8);
-                    image8 = NULL;
-                }
-                if (image24) {
-                    free(image24);
-                    image24 = NULL;
-                }
-                if (_8bit(path)) {
-                    image8 = bmp8_loadImage(path);
-                } else {
-                    image24 = bmp24_loadImage(path);
-                }
-                Sleep(2000);
-                if (image8 == NULL && image24 == NULL) {
+                if (scanf(" %255[^\n]", path) != 1) break;
+                image_free(&image);
+                if (image_load(&image, path, 0) != 0) {
                     printf("Failed to load image. Please check the file path and format.\n");
+                } else if (image.gray) {
+                    printf("8 bit image loaded successfully\n");
                 } else {
-                    if (image8) {
-                        printf("8 bit image loaded successfully\n");
-                    } else if (image24) {
-                        printf("24 bit image loaded successfully\n");
-                    }
+                    printf("24 bit image loaded successfully\n");
                 }
-                Sleep(2000);
                 break;
+            }
             case 2:
-                if (image8 || image24) {
-                    char path_2[256];
+                if (image.gray || image.color) {
+                    char path[256];
                     printf("File path: ");
-                    scanf("%s", path_2);
-                    if (image8) {
-                        bmp8_saveImage(path_2, image8);
-                    }
-
-                    if (image24) {
-                        bmp24_saveImage(path_2, image24);
+                    if (scanf(" %255[^\n]", path) != 1) break;
+                    if (image_save(&image, path) == 0) {
+                        printf("Image saved succesfully\n");
                     }
-                    printf("Image saved succesfully\n");
                 }
                 else
                     printf("Image is NULL\n");
                 break;
             case 3:
-                if (image8 || image24) {
+                if (image.gray || image.color) {
                     printf("Please choose a filter:\n 1. Negative\n 2. Brightness\n 3. Black and white\n 4. Box Blur\n 5. Gaussian blur\n 6. Sharpness\n 7. Outline\n 8. Emboss\n 9. Return to the previous menu\n >>> Your choice: ");
-                    int choix_2;
-                    scanf("%d", &choix_2);
-                    switch (choix_2) {
+                    int filter = 9;
+                    int value = 0;
+                    if (scanf("%d", &filter) != 1) filter = 9;
+                    switch (filter) {
                         case 1:
-                            if (image8) {
-                                bmp8_negative(image8);
-                            }
-                            if (image24) {
-                                bmp24_negative(image24);
-                            }
-                            printf("Filter applied successfully !\n");
+                            applyFromMenu(&image, OP_NEGATIVE, 0);
                             break;
                         case 2:
-                            int value;
                             printf("Enter brightness value (-255 to 255): ");
-                            scanf("%d", &value);
-                            if (image8) {
-                                bmp8_brightness(image8, value);
-                            }
-                            if (image24) {
-                                bmp24_brightness(image24, value);
-                            }
-                            printf("Filter applied successfully !\n");
+                            if (scanf("%d", &value) == 1) applyFromMenu(&image, OP_BRIGHTNESS, (float)value);
                             break;
                         case 3:
-                            if (image8) {
+                            if (image.gray) {
                                 printf("Enter threshold value (0 to 255): ");
-                                scanf("%d", &value);
-                                bmp8_threshold(image8, value);
-                            }
-                            if (image24) {
-                                bmp24_grayscale(image24);
+                                if (scanf("%d", &value) == 1) applyFromMenu(&image, OP_THRESHOLD, (float)value);
+                            } else {
+                                applyFromMenu(&image, OP_GRAYSCALE, 0);
                             }
-                            printf("Filter applied successfully !\n");
                             break;
                         case 4:
-                            if (image8) {
-                                bmp8_boxBlur(image8);
-                            }
-                            if (image24) {
-                                bmp24_boxBlur(image24);
-                            }
-                            printf("Filter applied successfully !\n");
+                            applyFromMenu(&image, OP_BOX_BLUR, 0);
                             break;
                         case 5:
-                            if (image8) {
-                                bmp8_gaussianBlur(image8);
-                            }
-                            if (image24) {
-                                bmp24_gaussianBlur(image24);
-                            }
-                            printf("Filter applied successfully !\n");
+                            applyFromMenu(&image, OP_GAUSSIAN_BLUR, 0);
                             break;
                         case 6:
-                            if (image8) {
-                                bmp8_sharpen(image8);
-                            }
-                            if (image24) {
-                                bmp24_sharpen(image24);
-                            }
-                            printf("Filter applied successfully !\n");
+                            applyFromMenu(&image, OP_SHARPEN, 0);
                             break;
                         case 7:
-                            if (image8) {
-                                bmp8_outline(image8);
-                            }
-                            if (image24) {
-                                bmp24_outline(image24);
-                            }
-                            printf("Filter applied successfully !\n");
+                            applyFromMenu(&image, OP_OUTLINE, 0);
                             break;
                         case 8:
-                            if (image8) {
-                                bmp8_emboss(image8);
-                            }
-                            if (image24) {
-                                bmp24_emboss(image24);
-                            }
-                            printf("Filter applied successfully !\n");
+                            applyFromMenu(&image, OP_EMBOSS, 0);
                             break;
                         case 9:
                             break;
@@ -170,27 +489,19 @@ int main(void) {
                     printf("Image is NULL\n");
                 break;
             case 4:
-                if (image8 || image24) {
-                    if (image8) {
-                        bmp8_printInfo(image8);
-                    }
-                    if (image24) {
-                        bmp24_printInfo(image24);
-                    }
-                }
-                else
+                if (image.gray) {
+                    bmp8_printInfo(image.gray);
+                } else if (image.color) {
+                    bmp24_printInfo(image.color);
+                } else {
                     printf("Image is NULL\n");
+                }
                 break;
             case 5:
-                if (image8 || image24) {
-                    if (image8) {
-                        bmp8_equalize(image8);
-                        printf("8-bit image equalized successfully\n");
-                    }
-                    if (image24) {
-                        bmp24_equalize(image24);
-                        printf("24-bit image equalized successfully\n");
-                    }
+                if (image.gray || image.color) {
+                    t_operation op = { OP_EQUALIZE, 0 };
+                    op_apply(&image, &op);
+                    printf("%s image equalized successfully\n", image.gray ? "8-bit" : "24-bit");
                 }
                 else
                     printf("Image is NULL\n");
@@ -198,11 +509,20 @@ int main(void) {
             case 6 :
                 break;
             default:
-                printf("Please enter a number between 1 and 5 !!\n");
+                printf("Please enter a number between 1 and 6 !!\n");
                 break;
+        }
+    }
+    image_free(&image);
+}
 
+int main(int argc, char** argv) {
+    const char* tracePath = getenv("BMP_TRACE");
+    if (tracePath && *tracePath) trace_start(tracePath);
 
-        }
+    if (argc > 1) {
+        return runBatch(argc, argv);
     }
+    runMenu();
     return 0;
 }
@@ -0,0 +1,352 @@
+#include "operations.h"
+#include "Histogram_equalization.h"
+#include "convolution.h"
+#include "file_map.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { VALUE_NONE, VALUE_INT, VALUE_FLOAT } t_valueKind;
+
+typedef struct {
+    const char* name;
+    t_valueKind value;
+    float low;
+    float high;
+    const char* help;
+} t_opInfo;
+
+// Indexed by t_opType.
+static const t_opInfo OPERATIONS[OP_COUNT] = {
+    { "negative",      VALUE_NONE,  0, 0,       "invert every channel" },
+    { "brightness",    VALUE_INT,   -255, 255,  "add VALUE to every channel" },
+    { "threshold",     VALUE_INT,   0, 255,     "8-bit only: black below VALUE, white from it" },
+    { "grayscale",     VALUE_NONE,  0, 0,       "average the channels (no-op on 8-bit)" },
+    { "box_blur",      VALUE_NONE,  0, 0,       "3x3 mean" },
+    { "gaussian_blur", VALUE_NONE,  0, 0,       "3x3 gaussian" },
+    { "sharpen",       VALUE_NONE,  0, 0,       "3x3 sharpen" },
+    { "outline",       VALUE_NONE,  0, 0,       "3x3 outline" },
+    { "emboss",        VALUE_NONE,  0, 0,       "3x3 emboss" },
+    { "equalize",      VALUE_NONE,  0, 0,       "histogram equalization" },
+    { "blur",          VALUE_INT,   1, CONV_MAX_BOX_RADIUS, "box blur of radius VALUE" },
+    { "fast_gaussian", VALUE_FLOAT, 0.1f, 1000, "three-box gaussian of sigma VALUE" },
+    { "median",        VALUE_INT,   1, 10000,   "median of radius VALUE (removes salt-and-pepper noise)" },
+    { "min",           VALUE_INT,   1, 10000,   "darkest sample within radius VALUE" },
+    { "max",           VALUE_INT,   1, 10000,   "brightest sample within radius VALUE" },
+    { "clahe",         VALUE_FLOAT, 0, 256,     "local equalization on 8x8 tiles, bins capped at VALUE x mean (0: no cap)" },
+    { "to_gray8",      VALUE_NONE,  0, 0,       "convert to an 8-bit luma image (no-op on 8-bit)" },
+};
+
+// Bit depth of a BMP header of got bytes, or -1.
+static int headerDepth(const unsigned char* header, size_t got) {
+    if (got < 54 || header[0] != 'B' || header[1] != 'M') return -1;
+    return header[28] | (header[29] << 8);
+}
+
+int image_depth(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return -1;
+
+    unsigned char header[54];
+    size_t got = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    return headerDepth(header, got);
+}
+
+// The file is opened (or mapped) once: the header read to tell the depth
+// apart is handed to the matching loader along with the open file.
+int image_load(t_image* image, const char* filename, int flags) {
+    image->gray = NULL;
+    image->color = NULL;
+
+    unsigned char header[54];
+    size_t got = 0;
+    FILE* file = NULL;
+    void* map = NULL;
+    size_t size = 0;
+    if (flags & LOAD_MAPPED) {
+        map = file_map(filename, &size);
+        if (!map) {
+            printf("Error: Cannot map file %s\n", filename);
+            return -1;
+        }
+        got = size < sizeof(header) ? size : sizeof(header);
+        memcpy(header, map, got);
+    } else {
+        file = fopen(filename, "rb");
+        if (!file) {
+            printf("Error: Cannot open file %s\n", filename);
+            return -1;
+        }
+        // Unbuffered: each part of the file comes in with one read().
+        setvbuf(file, NULL, _IONBF, 0);
+        got = fread(header, 1, sizeof(header), file);
+    }
+
+    int depth = headerDepth(header, got);
+    if (depth == 8) {
+        image->gray = map ? bmp8_fromMapping(map, size) : bmp8_readImage(file, header);
+    } else if (depth == 24) {
+        image->color = map ? bmp24_fromMapping(map, size) : bmp24_readImage(file, header);
+    } else {
+        if (depth < 0) {
+            printf("Error: Cannot read a BMP header from %s\n", filename);
+        } else {
+            printf("Error: Unsupported color depth %d in %s\n", depth, filename);
+        }
+        if (map) file_unmap(map, size);
+    }
+    if (file) fclose(file);
+    // From a mapping the pixels go straight from the file's pages to BGRX.
+    if (image->color && (flags & LOAD_BGRX) && bmp24_toBGRX(image->color) != 0) {
+        bmp24_free(image->color);
+        image->color = NULL;
+    }
+    return image->gray || image->color ? 0 : -1;
+}
+
+int image_save(const t_image* image, const char* filename) {
+    if (image->gray) return bmp8_saveImage(filename, image->gray);
+    if (image->color) return bmp24_saveImage(filename, image->color);
+    return -1;
+}
+
+void image_free(t_image* image) {
+    bmp8_free(image->gray);
+    bmp24_free(image->color);
+    image->gray = NULL;
+    image->color = NULL;
+}
+
+int image_width(const t_image* image) {
+    if (image->gray) return (int)image->gray->width;
+    if (image->color) return image->color->width;
+    return 0;
+}
+
+int image_height(const t_image* image) {
+    if (image->gray) return (int)image->gray->height;
+    if (image->color) return image->color->height;
+    return 0;
+}
+
+const char* op_name(t_opType type) {
+    return type >= 0 && type < OP_COUNT ? OPERATIONS[type].name : "unknown";
+}
+
+void op_printUsage(FILE* out) {
+    for (int i = 0; i < OP_COUNT; i++) {
+        const t_opInfo* info = &OPERATIONS[i];
+        char name[32];
+        snprintf(name, sizeof(name), "%s%s", info->name, info->value == VALUE_NONE ? "" : "=VALUE");
+        fprintf(out, "  %-20s %s\n", name, info->help);
+    }
+}
+
+static int parseOne(const char* text, size_t length, t_operation* op) {
+    const char* equals = memchr(text, '=', length);
+    size_t nameLength = equals ? (size_t)(equals - text) : length;
+
+    for (int i = 0; i < OP_COUNT; i++) {
+        const t_opInfo* info = &OPERATIONS[i];
+        if (strlen(info->name) != nameLength || strncmp(info->name, text, nameLength) != 0) continue;
+
+        op->type = (t_opType)i;
+        op->value = 0;
+        if (info->value == VALUE_NONE) {
+            if (equals) {
+                printf("Error: Operation %s takes no value\n", info->name);
+                return -1;
+            }
+            return 0;
+        }
+        if (!equals) {
+            printf("Error: Operation %s needs a value (%s=VALUE)\n", info->name, info->name);
+            return -1;
+        }
+
+        char value[32];
+        size_t valueLength = length - nameLength - 1;
+        if (valueLength == 0 || valueLength >= sizeof(value)) {
+            printf("Error: Bad value for %s\n", info->name);
+            return -1;
+        }
+        memcpy(value, equals + 1, valueLength);
+        value[valueLength] = '\0';
+
+        char* end;
+        errno = 0;
+        if (info->value == VALUE_INT) {
+            long parsed = strtol(value, &end, 10);
+            op->value = (float)parsed;
+        } else {
+            op->value = strtof(value, &end);
+        }
+        // Written so that NaN, which compares false with everything, is out of range.
+        if (errno || *end != '\0' || !(op->value >= info->low && op->value <= info->high)) {
+            printf("Error: Value for %s must be a number in [%g, %g], got \"%s\"\n", info->name, info->low, info->high, value);
+            return -1;
+        }
+        return 0;
+    }
+
+    printf("Error: Unknown operation \"%.*s\"\n", (int)nameLength, text);
+    return -1;
+}
+
+int op_parseList(const char* text, t_operation* ops, int maxOps) {
+    int count = 0;
+    const char* start = text;
+    while (*start) {
+        const char* end = strchr(start, ',');
+        size_t length = end ? (size_t)(end - start) : strlen(start);
+        if (length > 0) {
+            if (count == maxOps) {
+                printf("Error: More than %d operations\n", maxOps);
+                return -1;
+            }
+            if (parseOne(start, length, &ops[count]) != 0) return -1;
+            count++;
+        }
+        if (!end) break;
+        start = end + 1;
+    }
+    return count;
+}
+
+int op_radius(const t_operation* op) {
+    switch (op->type) {
+        case OP_BOX_BLUR:
+        case OP_GAUSSIAN_BLUR:
+        case OP_SHARPEN:
+        case OP_OUTLINE:
+        case OP_EMBOSS:
+            return 1;
+        case OP_BLUR:
+        case OP_MEDIAN:
+        case OP_MIN:
+        case OP_MAX:
+            return (int)op->value;
+        case OP_FAST_GAUSSIAN:
+            return conv_fastGaussianRadius(op->value);
+        default:
+            return 0;
+    }
+}
+
+int op_apply(t_image* image, const t_operation* op) {
+    t_bmp8* gray = image->gray;
+    t_bmp24* color = image->color;
+    if (!gray && !color) return -1;
+
+    switch (op->type) {
+        case OP_NEGATIVE:
+            if (gray) bmp8_negative(gray); else bmp24_negative(color);
+            return 0;
+        case OP_BRIGHTNESS:
+            if (gray) bmp8_brightness(gray, (int)op->value); else bmp24_brightness(color, (int)op->value);
+            return 0;
+        case OP_THRESHOLD:
+            if (!gray) return -1;
+            bmp8_threshold(gray, (int)op->value);
+            return 0;
+        case OP_GRAYSCALE:
+            if (color) bmp24_grayscale(color);
+            return 0;
+        case OP_BOX_BLUR:
+            if (gray) bmp8_boxBlur(gray); else bmp24_boxBlur(color);
+            return 0;
+        case OP_GAUSSIAN_BLUR:
+            if (gray) bmp8_gaussianBlur(gray); else bmp24_gaussianBlur(color);
+            return 0;
+        case OP_SHARPEN:
+            if (gray) bmp8_sharpen(gray); else bmp24_sharpen(color);
+            return 0;
+        case OP_OUTLINE:
+            if (gray) bmp8_outline(gray); else bmp24_outline(color);
+            return 0;
+        case OP_EMBOSS:
+            if (gray) bmp8_emboss(gray); else bmp24_emboss(color);
+            return 0;
+        case OP_EQUALIZE:
+            if (gray) bmp8_equalize(gray); else bmp24_equalize(color);
+            return 0;
+        case OP_BLUR:
+            if (gray) bmp8_boxBlurRadius(gray, (int)op->value); else bmp24_boxBlurRadius(color, (int)op->value);
+            return 0;
+        case OP_FAST_GAUSSIAN:
+            if (gray) bmp8_fastGaussianBlur(gray, op->value); else bmp24_fastGaussianBlur(color, op->value);
+            return 0;
+        case OP_MEDIAN:
+            if (gray) bmp8_medianFilter(gray, (int)op->value); else bmp24_medianFilter(color, (int)op->value);
+            return 0;
+        case OP_MIN:
+            if (gray) bmp8_minFilter(gray, (int)op->value); else bmp24_minFilter(color, (int)op->value);
+            return 0;
+        case OP_MAX:
+            if (gray) bmp8_maxFilter(gray, (int)op->value); else bmp24_maxFilter(color, (int)op->value);
+            return 0;
+        case OP_CLAHE:
+            if (gray) {
+                bmp8_clahe(gray, CLAHE_TILES, CLAHE_TILES, op->value);
+            } else {
+                bmp24_clahe(color, CLAHE_TILES, CLAHE_TILES, op->value);
+            }
+            return 0;
+        case OP_TO_GRAY8:
+            if (color) {
+                t_bmp8* converted = bmp24_toGray8(color);
+                if (!converted) return -1;
+                bmp24_free(color);
+                image->color = NULL;
+                image->gray = converted;
+            }
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static int isPointOp(t_opType type) {
+    return type == OP_NEGATIVE || type == OP_BRIGHTNESS || type == OP_THRESHOLD;
+}
+
+int op_applyList(t_image* image, const t_operation* ops, int count, int* failed) {
+    int k = 0;
+    while (k < count) {
+        if (!isPointOp(ops[k].type)) {
+            if (op_apply(image, &ops[k]) != 0) {
+                *failed = k;
+                return -1;
+            }
+            k++;
+            continue;
+        }
+
+        t_pointOps chain;
+        pointOps_init(&chain);
+        for (; k < count && isPointOp(ops[k].type); k++) {
+            switch (ops[k].type) {
+                case OP_NEGATIVE:
+                    pointOps_negative(&chain);
+                    break;
+                case OP_BRIGHTNESS:
+                    pointOps_brightness(&chain, (int)ops[k].value);
+                    break;
+                default:
+                    if (!image->gray) {
+                        *failed = k;
+                        return -1;
+                    }
+                    pointOps_threshold(&chain, (int)ops[k].value);
+                    break;
+            }
+        }
+        if (image->gray) {
+            bmp8_applyPointOps(image->gray, &chain);
+        } else {
+            bmp24_applyPointOps(image->color, &chain);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef OPERATIONS_H
+#define OPERATIONS_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// An image of either supported depth; exactly one of the two is set.
+typedef struct {
+    t_bmp8* gray;
+    t_bmp24* color;
+} t_image;
+
+typedef enum {
+    OP_NEGATIVE,
+    OP_BRIGHTNESS,
+    OP_THRESHOLD,
+    OP_GRAYSCALE,
+    OP_BOX_BLUR,
+    OP_GAUSSIAN_BLUR,
+    OP_SHARPEN,
+    OP_OUTLINE,
+    OP_EMBOSS,
+    OP_EQUALIZE,
+    OP_BLUR,
+    OP_FAST_GAUSSIAN,
+    OP_MEDIAN,
+    OP_MIN,
+    OP_MAX,
+    OP_CLAHE,
+    OP_TO_GRAY8,
+    OP_COUNT
+} t_opType;
+
+typedef struct {
+    t_opType type;
+    float value;
+} t_operation;
+
+#define MAX_OPERATIONS 64
+
+// Bit depth from the file header: 8, 24, or -1 if unreadable.
+int image_depth(const char* filename);
+
+// image_load flags: read the file through a copy-on-write mapping, and hold
+// 24-bit pixels as BGRX (see bmp24_toBGRX; 8-bit images are unaffected).
+#define LOAD_MAPPED 1
+#define LOAD_BGRX 2
+
+int image_load(t_image* image, const char* filename, int flags);
+int image_save(const t_image* image, const char* filename);
+void image_free(t_image* image);
+int image_width(const t_image* image);
+int image_height(const t_image* image);
+
+// Parses a comma-separated list such as "brightness=20,negative,blur=5"
+// into ops. Returns the number of operations or -1 (after printing why).
+int op_parseList(const char* text, t_operation* ops, int maxOps);
+const char* op_name(t_opType type);
+void op_printUsage(FILE* out);
+
+// Rows of context the operation reads above and below each output row.
+// Equalize and clahe depend on the whole image and report 0; callers working
+// on pieces of an image must treat them separately.
+int op_radius(const t_operation* op);
+
+// Returns 0, or -1 when the operation does not apply to the image's depth.
+// to_gray8 replaces a 24-bit image by its 8-bit conversion.
+int op_apply(t_image* image, const t_operation* op);
+
+// Applies count operations in order. Consecutive point operations (negative,
+// brightness, threshold) are folded into one lookup table and one pass.
+// Returns 0, or -1 with *failed set to the index of the operation that does
+// not apply to the image's depth.
+int op_applyList(t_image* image, const t_operation* ops, int count, int* failed);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PIXEL_FORMAT_H
+#define PIXEL_FORMAT_H
+
+// Interleaved 8-bit pixel layouts the processing cores are specialized for.
+// A format is identified by its number of samples per pixel, which is what a
+// t_view's channels holds.
+typedef enum {
+    PIXEL_GRAY8 = 1,    // t_bmp8
+    PIXEL_BGR24 = 3,    // t_bmp24
+    PIXEL_BGRX32 = 4    // BGR plus an unused byte: aligned pixels for working copies
+} t_pixelFormat;
+
+#define PIXEL_MAX_CHANNELS 4
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define PIXEL_UNROLL _Pragma("GCC unroll 4")
+#else
+#define ALWAYS_INLINE inline
+#define PIXEL_UNROLL
+#endif
+
+// Kernels are written once, as ALWAYS_INLINE functions taking the channel
+// count, and called through PIXEL_DISPATCH, which instantiates call once per
+// format with PIXEL_CHANNELS a compile-time constant. Per-channel loops
+// marked PIXEL_UNROLL then unroll completely (-O2 leaves such loops rolled
+// otherwise), as in a hand-written copy. Other counts (up to
+// PIXEL_MAX_CHANNELS) run the same source with the count known at run time.
+//
+//     PIXEL_DISPATCH(view->channels, rowSums(row, width, PIXEL_CHANNELS, sums));
+//
+//     PIXEL_UNROLL for (int c = 0; c < channels; c++) { ... }
+#define PIXEL_DISPATCH(channels, call) \
+    do { \
+        switch (channels) { \
+            case PIXEL_GRAY8: { enum { PIXEL_CHANNELS = PIXEL_GRAY8 }; call; break; } \
+            case PIXEL_BGR24: { enum { PIXEL_CHANNELS = PIXEL_BGR24 }; call; break; } \
+            case PIXEL_BGRX32: { enum { PIXEL_CHANNELS = PIXEL_BGRX32 }; call; break; } \
+            default: { const int PIXEL_CHANNELS = (channels); call; break; } \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,201 @@
+#include "point_ops.h"
+#include "cpu_features.h"
+#include "thread_pool.h"
+#include <limits.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Views are processed in chunks of at least POINT_CHUNK bytes.
+#define POINT_CHUNK (1 << 16)
+
+void pointOps_init(t_pointOps* ops) {
+    for (int c = 0; c < PIXEL_MAX_CHANNELS; c++) {
+        for (int v = 0; v < 256; v++) {
+            ops->table[c][v] = (unsigned char)v;
+        }
+    }
+}
+
+void pointOps_mapChannel(t_pointOps* ops, int channel, const unsigned char map[256]) {
+    unsigned char* table = ops->table[channel];
+    for (int v = 0; v < 256; v++) {
+        table[v] = map[table[v]];
+    }
+}
+
+void pointOps_map(t_pointOps* ops, const unsigned char map[256]) {
+    for (int c = 0; c < PIXEL_MAX_CHANNELS; c++) {
+        pointOps_mapChannel(ops, c, map);
+    }
+}
+
+void pointOps_negative(t_pointOps* ops) {
+    unsigned char map[256];
+    for (int v = 0; v < 256; v++) {
+        map[v] = (unsigned char)(255 - v);
+    }
+    pointOps_map(ops, map);
+}
+
+void pointOps_brightness(t_pointOps* ops, int value) {
+    unsigned char map[256];
+    for (int v = 0; v < 256; v++) {
+        int shifted = v + value;
+        map[v] = (unsigned char)(shifted > 255 ? 255 : shifted < 0 ? 0 : shifted);
+    }
+    pointOps_map(ops, map);
+}
+
+void pointOps_threshold(t_pointOps* ops, int threshold) {
+    unsigned char map[256];
+    for (int v = 0; v < 256; v++) {
+        map[v] = v >= threshold ? 255 : 0;
+    }
+    pointOps_map(ops, map);
+}
+
+// Table plus the layout the vector path shuffles from, built once per apply.
+typedef struct {
+    const unsigned char* table;
+    unsigned char parts[16][16];
+} t_lookup;
+
+typedef void (*t_mapFn)(const t_lookup* lookup, unsigned char* data, size_t count);
+
+static void mapScalar(const t_lookup* lookup, unsigned char* data, size_t count) {
+    const unsigned char* table = lookup->table;
+    for (size_t i = 0; i < count; i++) {
+        data[i] = table[data[i]];
+    }
+}
+
+// Byte-shuffle lookup. Each half of the table (v < 128 and v >= 128) is split
+// into eight 16-byte parts, stored as differences: part k holds
+// table[16k + l] ^ table[16(k-1) + l]. Shuffling part k with index v - 16k
+// leaves a lane non-zero only when v - 16k does not go negative, so XOR-ing
+// parts 0..7 telescopes to the entry of the lane's own 16-byte group. A blend
+// on bit 7 then picks the lower- or upper-half result.
+static void prepareLookup(t_lookup* lookup, const unsigned char* table) {
+    lookup->table = table;
+    for (int k = 0; k < 16; k++) {
+        for (int l = 0; l < 16; l++) {
+            unsigned char previous = k % 8 == 0 ? 0 : table[16 * (k - 1) + l];
+            lookup->parts[k][l] = table[16 * k + l] ^ previous;
+        }
+    }
+}
+
+#ifdef CPU_X86
+
+// Only the 32-byte form pays off: with 16-byte shuffles the sixteen lookups
+// per vector cost more than the scalar table walk.
+TARGET_AVX2 static void mapAVX2(const t_lookup* lookup, unsigned char* data, size_t count) {
+    __m256i parts[16];
+    for (int k = 0; k < 16; k++) {
+        parts[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)lookup->parts[k]));
+    }
+    const __m256i step = _mm256_set1_epi8(16);
+    const __m256i high = _mm256_set1_epi8((char)0x80);
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i lowIndex = v;
+        __m256i highIndex = _mm256_xor_si256(v, high);
+        __m256i low = _mm256_shuffle_epi8(parts[0], lowIndex);
+        __m256i upper = _mm256_shuffle_epi8(parts[8], highIndex);
+        for (int k = 1; k < 8; k++) {
+            lowIndex = _mm256_sub_epi8(lowIndex, step);
+            highIndex = _mm256_sub_epi8(highIndex, step);
+            low = _mm256_xor_si256(low, _mm256_shuffle_epi8(parts[k], lowIndex));
+            upper = _mm256_xor_si256(upper, _mm256_shuffle_epi8(parts[8 + k], highIndex));
+        }
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_blendv_epi8(low, upper, v));
+    }
+    mapScalar(lookup, data + i, count - i);
+}
+
+#endif
+
+static t_mapFn mapFor(t_simdLevel level) {
+#ifdef CPU_X86
+    if (level >= SIMD_AVX2) return mapAVX2;
+#else
+    (void)level;
+#endif
+    return mapScalar;
+}
+
+typedef struct {
+    const t_pointOps* ops;
+    t_view* view;
+    unsigned char* first;   // lowest-addressed row
+    int uniform;            // all channels share table[0]
+    t_lookup lookup;
+    t_mapFn map;
+} t_applyJob;
+
+static ALWAYS_INLINE void mapChannels(const t_pointOps* ops, unsigned char* data, size_t pixels, int channels) {
+    for (size_t i = 0; i < pixels; i++) {
+        PIXEL_UNROLL for (int c = 0; c < channels; c++) {
+            data[i * channels + c] = ops->table[c][data[i * channels + c]];
+        }
+    }
+}
+
+static void mapPixels(const t_applyJob* job, unsigned char* data, size_t pixels) {
+    int channels = job->view->channels;
+    if (job->uniform) {
+        job->map(&job->lookup, data, pixels * channels);
+        return;
+    }
+    PIXEL_DISPATCH(channels, mapChannels(job->ops, data, pixels, PIXEL_CHANNELS));
+}
+
+// Rows without padding between them are one contiguous run of pixels,
+// starting at the lowest-addressed row.
+static void applyPixels(void* context, int begin, int end) {
+    t_applyJob* job = (t_applyJob*)context;
+    mapPixels(job, job->first + (size_t)begin * job->view->channels, (size_t)(end - begin));
+}
+
+static void applyRows(void* context, int y0, int y1) {
+    t_applyJob* job = (t_applyJob*)context;
+    for (int y = y0; y < y1; y++) {
+        mapPixels(job, view_row(job->view, y), (size_t)job->view->width);
+    }
+}
+
+void pointOps_apply(const t_pointOps* ops, t_view* view) {
+    if (!ops || !view || !view->data || view->width <= 0 || view->height <= 0) return;
+    if (view->channels < 1 || view->channels > PIXEL_MAX_CHANNELS) return;
+
+    unsigned char* first = view->stride < 0 ? view_row(view, view->height - 1) : view->data;
+    t_applyJob job;
+    job.ops = ops;
+    job.view = view;
+    job.first = first;
+    job.uniform = 1;
+    for (int c = 1; c < view->channels; c++) {
+        if (memcmp(ops->table[c], ops->table[0], 256) != 0) job.uniform = 0;
+    }
+    prepareLookup(&job.lookup, ops->table[0]);
+    job.map = mapFor(cpu_simdLevel());
+
+    int rowLen = view->width * view->channels;
+    if ((view->stride == rowLen || view->stride == -rowLen) && (long long)view->width * view->height <= INT_MAX) {
+        threadPool_forBands(view->width * view->height, POINT_CHUNK / view->channels, applyPixels, &job);
+    } else {
+        int minRows = POINT_CHUNK / rowLen > 0 ? POINT_CHUNK / rowLen : 1;
+        threadPool_forBands(view->height, minRows, applyRows, &job);
+    }
+}
+
+void pointOps_mapBytes(const unsigned char table[256], unsigned char* data, size_t count) {
+    t_lookup lookup;
+    prepareLookup(&lookup, table);
+    mapFor(cpu_simdLevel())(&lookup, data, count);
+}
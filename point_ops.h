@@ -0,0 +1,32 @@
+#ifndef POINT_OPS_H
+#define POINT_OPS_H
+
+#include "image_view.h"
+#include "pixel_format.h"
+
+// A chain of per-sample operations folded into one lookup table per channel:
+// a sample of value v in channel c becomes table[c][v]. Channels are in memory
+// order (blue, green, red for 24-bit pixels); 8-bit images use table[0].
+typedef struct {
+    unsigned char table[PIXEL_MAX_CHANNELS][256];
+} t_pointOps;
+
+// Starts an empty chain. Every following call appends one operation, which
+// runs after the ones already in the chain.
+void pointOps_init(t_pointOps* ops);
+void pointOps_negative(t_pointOps* ops);
+void pointOps_brightness(t_pointOps* ops, int value);
+void pointOps_threshold(t_pointOps* ops, int threshold);
+void pointOps_map(t_pointOps* ops, const unsigned char map[256]);
+void pointOps_mapChannel(t_pointOps* ops, int channel, const unsigned char map[256]);
+
+// Applies the whole chain in one pass over the view, on the thread pool. When
+// all channels share a table the lookup is vectorized with AVX2 byte shuffles
+// when cpu_simdLevel() allows it.
+void pointOps_apply(const t_pointOps* ops, t_view* view);
+
+// Maps count bytes in place through one table, on the calling thread, with
+// the same vector path as pointOps_apply.
+void pointOps_mapBytes(const unsigned char table[256], unsigned char* data, size_t count);
+
+#endif
@@ -0,0 +1,225 @@
+#include "rank_filter.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define COARSE_BINS 16
+#define FINE_BINS 256
+
+// Samples per tile row. The column histograms of a tile (512 bytes per
+// sample column) then stay within the L2 cache.
+#define TILE_SAMPLES 768
+
+typedef struct {
+    t_view* view;
+    t_view source;      // unfiltered copy, read by every tile
+    int radius;
+    uint32_t rank;
+    int tileWidth;
+    int tilesX;
+    int bands;
+} t_rankJob;
+
+// Column histograms of the window rows around the current row, for the
+// image columns [first, first + columns) a tile reads.
+typedef struct {
+    int first;
+    int columns;
+    int channels;
+    uint16_t* fine;     // [column][channel][FINE_BINS]
+    uint16_t* coarse;   // [column][channel][COARSE_BINS]
+} t_columns;
+
+static int minInt(int a, int b) { return a < b ? a : b; }
+static int maxInt(int a, int b) { return a > b ? a : b; }
+
+static int clampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// Adds weight copies of row's samples to the column histograms.
+static void columnsAdd(t_columns* cols, const unsigned char* row, int weight) {
+    int c = cols->channels;
+    const unsigned char* sample = row + (size_t)cols->first * c;
+    for (int k = 0; k < cols->columns * c; k++) {
+        int v = sample[k];
+        cols->fine[(size_t)k * FINE_BINS + v] += weight;
+        cols->coarse[(size_t)k * COARSE_BINS + (v >> 4)] += weight;
+    }
+}
+
+// Histograms of rows [y - radius, y + radius], edge rows repeated.
+static void columnsInit(t_columns* cols, const t_view* source, int y, int radius) {
+    int last = source->height - 1;
+    int top = y - radius, bottom = y + radius;
+    if (top < 0) columnsAdd(cols, view_row(source, 0), -top);
+    if (bottom > last) columnsAdd(cols, view_row(source, last), bottom - last);
+    for (int p = maxInt(top, 0); p <= minInt(bottom, last); p++) {
+        columnsAdd(cols, view_row(source, p), 1);
+    }
+}
+
+// Adds bins [from, from + count) of the columns around x, edge columns
+// repeated, to sums. stride and hist select the fine or coarse histograms.
+static void windowSum(const t_columns* cols, const uint16_t* hist, int stride, int ch, int width,
+                      int x, int radius, int from, int count, uint32_t* sums) {
+    int c = cols->channels;
+    int left = x - radius, right = x + radius;
+    for (int col = maxInt(left, 0); col <= minInt(right, width - 1); col++) {
+        const uint16_t* bins = hist + ((size_t)(col - cols->first) * c + ch) * stride + from;
+        for (int b = 0; b < count; b++) {
+            sums[b] += bins[b];
+        }
+    }
+    int extra[2] = { -left, right - (width - 1) };
+    int edge[2] = { 0, width - 1 };
+    for (int side = 0; side < 2; side++) {
+        if (extra[side] <= 0) continue;
+        const uint16_t* bins = hist + ((size_t)(edge[side] - cols->first) * c + ch) * stride + from;
+        for (int b = 0; b < count; b++) {
+            sums[b] += (uint32_t)bins[b] * extra[side];
+        }
+    }
+}
+
+// sums += column entering - column leaving, for bins [from, from + count).
+static void windowSlide(const t_columns* cols, const uint16_t* hist, int stride, int ch,
+                        int entering, int leaving, int from, int count, uint32_t* sums) {
+    int c = cols->channels;
+    const uint16_t* in = hist + ((size_t)(entering - cols->first) * c + ch) * stride + from;
+    const uint16_t* out = hist + ((size_t)(leaving - cols->first) * c + ch) * stride + from;
+    for (int b = 0; b < count; b++) {
+        sums[b] += in[b] - out[b];
+    }
+}
+
+// One channel of output row y over the tile's columns [x0, x1).
+static void rankRow(const t_rankJob* job, const t_columns* cols, int ch, int y, int x0, int x1) {
+    int width = job->view->width;
+    int radius = job->radius;
+    int c = cols->channels;
+    uint32_t coarse[COARSE_BINS] = { 0 };
+    uint32_t fine[FINE_BINS];
+    int fineAt[COARSE_BINS];   // x each fine segment is up to date for
+    for (int s = 0; s < COARSE_BINS; s++) {
+        fineAt[s] = INT_MIN;
+    }
+    windowSum(cols, cols->coarse, COARSE_BINS, ch, width, x0, radius, 0, COARSE_BINS, coarse);
+
+    unsigned char* out = view_row(job->view, y);
+    for (int x = x0; x < x1; x++) {
+        uint32_t rank = job->rank;
+        int s = 0;
+        while (rank >= coarse[s]) {
+            rank -= coarse[s];
+            s++;
+        }
+
+        // Bring the fine bins of segment s to x: slide them when they are
+        // close behind, otherwise sum them again.
+        uint32_t* segment = fine + s * COARSE_BINS;
+        if (fineAt[s] != INT_MIN && (x - fineAt[s]) * 2 <= 2 * radius + 1) {
+            for (int step = fineAt[s] + 1; step <= x; step++) {
+                windowSlide(cols, cols->fine, FINE_BINS, ch, clampInt(step + radius, 0, width - 1),
+                            clampInt(step - radius - 1, 0, width - 1), s * COARSE_BINS, COARSE_BINS, segment);
+            }
+        } else {
+            memset(segment, 0, COARSE_BINS * sizeof(uint32_t));
+            windowSum(cols, cols->fine, FINE_BINS, ch, width, x, radius, s * COARSE_BINS, COARSE_BINS, segment);
+        }
+        fineAt[s] = x;
+
+        int b = 0;
+        while (rank >= segment[b]) {
+            rank -= segment[b];
+            b++;
+        }
+        out[x * c + ch] = (unsigned char)(s * COARSE_BINS + b);
+
+        if (x + 1 < x1) {
+            windowSlide(cols, cols->coarse, COARSE_BINS, ch, clampInt(x + 1 + radius, 0, width - 1),
+                        clampInt(x - radius, 0, width - 1), 0, COARSE_BINS, coarse);
+        }
+    }
+}
+
+static void rankTile(void* context, int index) {
+    t_rankJob* job = (t_rankJob*)context;
+    const t_view* source = &job->source;
+    int width = source->width, height = source->height;
+    int radius = job->radius;
+    int c = source->channels;
+
+    int tileX = index % job->tilesX, band = index / job->tilesX;
+    int x0 = tileX * job->tileWidth;
+    int x1 = minInt(width, x0 + job->tileWidth);
+    int y0 = (int)((long long)height * band / job->bands);
+    int y1 = (int)((long long)height * (band + 1) / job->bands);
+    if (y0 >= y1) return;
+
+    t_columns cols;
+    cols.first = maxInt(0, x0 - radius);
+    cols.columns = minInt(width, x1 + radius) - cols.first;
+    cols.channels = c;
+    size_t histograms = (size_t)cols.columns * c;
+    cols.fine = (uint16_t*)bufferPool_getZeroed(histograms * (FINE_BINS + COARSE_BINS) * sizeof(uint16_t), 0);
+    if (!cols.fine) return;
+    cols.coarse = cols.fine + histograms * FINE_BINS;
+
+    columnsInit(&cols, source, y0, radius);
+    for (int y = y0; y < y1; y++) {
+        for (int ch = 0; ch < c; ch++) {
+            rankRow(job, &cols, ch, y, x0, x1);
+        }
+        if (y + 1 < y1) {
+            columnsAdd(&cols, view_row(source, minInt(y + radius + 1, height - 1)), 1);
+            columnsAdd(&cols, view_row(source, maxInt(y - radius, 0)), -1);
+        }
+    }
+    bufferPool_release(cols.fine);
+}
+
+static void copyBand(void* context, int y0, int y1) {
+    t_rankJob* job = (t_rankJob*)context;
+    size_t rowBytes = (size_t)job->view->width * job->view->channels;
+    for (int y = y0; y < y1; y++) {
+        memcpy(view_row(&job->source, y), view_row(job->view, y), rowBytes);
+    }
+}
+
+void rank_filter(t_view* view, int radius, float percentile) {
+    if (!view || !view->data || view->width <= 0 || view->height <= 0) return;
+    if (radius <= 0 || radius > RANK_MAX_RADIUS) return;
+
+    size_t rowBytes = (size_t)view->width * view->channels;
+    unsigned char* copy = (unsigned char*)bufferPool_get(rowBytes * view->height, 0);
+    if (!copy) return;
+
+    t_rankJob job;
+    job.view = view;
+    job.source = *view;
+    job.source.data = copy;
+    job.source.stride = (int)rowBytes;
+    job.radius = radius;
+    double window = (2.0 * radius + 1) * (2.0 * radius + 1);
+    if (percentile < 0) percentile = 0;
+    if (percentile > 100) percentile = 100;
+    job.rank = (uint32_t)floor(percentile / 100.0 * (window - 1) + 0.5);
+
+    // Narrow tiles keep the column histograms in cache; split the rows too
+    // when there are fewer tiles than threads, in bands tall enough to pay
+    // for refilling the histograms.
+    job.tileWidth = maxInt(TILE_SAMPLES / view->channels, 16);
+    job.tilesX = (view->width + job.tileWidth - 1) / job.tileWidth;
+    job.bands = 1;
+    if (job.tilesX < threadPool_threadCount()) {
+        job.bands = threadPool_bandCount(view->height, maxInt(64, 4 * radius));
+    }
+
+    threadPool_forBands(view->height, 16, copyBand, &job);
+    threadPool_parallelFor(job.tilesX * job.bands, rankTile, &job);
+    bufferPool_release(copy);
+}
@@ -0,0 +1,19 @@
+#ifndef RANK_FILTER_H
+#define RANK_FILTER_H
+
+#include "image_view.h"
+
+// Rank filters over a (2 * radius + 1)^2 window, per channel: each sample
+// becomes the window value at the given percentile, 0 being the minimum,
+// 50 the median and 100 the maximum (rounded to the nearest rank). Samples
+// past the border repeat the edge pixel, as in conv_boxBlur.
+//
+// Column histograms slide down the image and a window histogram slides
+// along each row (Perreault and Hebert), with 16 coarse bins kept up to
+// date and the 256 fine bins refreshed only in the coarse bin the rank
+// falls in. The cost per pixel does not grow with the radius.
+#define RANK_MAX_RADIUS 32767
+
+void rank_filter(t_view* view, int radius, float percentile);
+
+#endif
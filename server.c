@@ -0,0 +1,341 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "server.h"
+#include "cpu_features.h"
+#include "file_map.h"
+#include "thread_pool.h"
+#include "timing.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Longest request or reply line, newline included.
+#define SERVER_LINE 4096
+
+#ifdef _WIN32
+
+int server_run(const char* socketPath, int loadFlags) {
+    (void)socketPath;
+    (void)loadFlags;
+    printf("Error: Server mode needs Unix domain sockets\n");
+    return -1;
+}
+
+int server_submit(const char* socketPath, t_batchItem* items, int count, const char* opText,
+                  t_batchReportFn report, void* context) {
+    (void)socketPath;
+    (void)items;
+    (void)count;
+    (void)opText;
+    (void)report;
+    (void)context;
+    printf("Error: Server mode needs Unix domain sockets\n");
+    return -1;
+}
+
+#else
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int signal) {
+    (void)signal;
+    stopRequested = 1;
+}
+
+static int socketAddress(const char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        printf("Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+static int connectTo(const struct sockaddr_un* address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr*)address, sizeof(*address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads one line into line without its newline. Returns its length, -1 at
+// the end of the stream, or -2 (the rest of the line skipped) when it does
+// not fit.
+static int readLine(FILE* in, char* line, size_t size) {
+    if (!fgets(line, (int)size, in)) return -1;
+    size_t length = strlen(line);
+    if (length > 0 && line[length - 1] == '\n') {
+        line[--length] = '\0';
+        return (int)length;
+    }
+    if (feof(in)) return (int)length;
+    int c;
+    while ((c = fgetc(in)) != '\n' && c != EOF) {
+    }
+    return -2;
+}
+
+// Runs the request in line, which is split in place, and fills in item.
+static void runJob(char* line, int loadFlags, t_batchItem* item) {
+    memset(item, 0, sizeof(*item));
+    item->input = line;
+    item->output = "";
+    char* opText = strchr(line, '\t');
+    char* output = opText ? strchr(opText + 1, '\t') : NULL;
+    if (!output) {
+        snprintf(item->error, sizeof(item->error), "expected INPUT<tab>OPERATIONS<tab>OUTPUT");
+        return;
+    }
+    *opText++ = '\0';
+    *output++ = '\0';
+    item->output = output;
+    if (file_same(item->input, item->output)) {
+        snprintf(item->error, sizeof(item->error), "output would overwrite the input");
+        return;
+    }
+
+    t_operation ops[MAX_OPERATIONS];
+    int opCount = op_parseList(opText, ops, MAX_OPERATIONS);
+    if (opCount < 0) {
+        snprintf(item->error, sizeof(item->error), "invalid operations %.120s", opText);
+        return;
+    }
+
+    double start = trace_begin();
+    double begin = timing_now();
+    t_image image;
+    if (image_load(&image, item->input, loadFlags) != 0) {
+        snprintf(item->error, sizeof(item->error), "cannot load");
+    }
+    double loaded = timing_now();
+
+    int failedOp;
+    if (!item->error[0] && op_applyList(&image, ops, opCount, &failedOp) != 0) {
+        snprintf(item->error, sizeof(item->error), "%s is not available for %s images",
+                 op_name(ops[failedOp].type), image.gray ? "8-bit" : "24-bit");
+    }
+    double processed = timing_now();
+
+    if (!item->error[0]) {
+        if (image_save(&image, item->output) != 0) {
+            snprintf(item->error, sizeof(item->error), "cannot save");
+        } else {
+            item->pixels = (double)image_width(&image) * image_height(&image);
+        }
+    }
+    image_free(&image);
+    double end = timing_now();
+    trace_end("server_job", start);
+
+    item->loadSeconds = loaded - begin;
+    item->processSeconds = processed - loaded;
+    item->saveSeconds = end - processed;
+    item->seconds = end - begin;
+}
+
+static void serveConnection(int connection, int loadFlags) {
+    FILE* in = fdopen(connection, "r");
+    if (!in) {
+        close(connection);
+        return;
+    }
+
+    char line[SERVER_LINE];
+    int length;
+    while (!stopRequested && (length = readLine(in, line, sizeof(line))) != -1) {
+        if (length == 0) continue;
+        t_batchItem item;
+        if (length == -2) {
+            memset(&item, 0, sizeof(item));
+            item.input = item.output = "";
+            snprintf(item.error, sizeof(item.error), "request longer than %d bytes", SERVER_LINE - 1);
+        } else {
+            runJob(line, loadFlags, &item);
+        }
+
+        int sent;
+        if (!item.error[0]) {
+            printf("ok     %s -> %s (%.1f ms)\n", item.input, item.output, item.seconds * 1e3);
+            sent = dprintf(connection, "ok %.3f %.3f %.3f %.3f %.0f\n", item.seconds * 1e3,
+                           item.loadSeconds * 1e3, item.processSeconds * 1e3, item.saveSeconds * 1e3,
+                           item.pixels);
+        } else {
+            printf("FAILED %s: %s\n", item.input, item.error);
+            sent = dprintf(connection, "error %s\n", item.error);
+        }
+        fflush(stdout);
+        if (sent < 0) break;
+    }
+    fclose(in);
+}
+
+static void idleTask(void* context, int index) {
+    (void)context;
+    (void)index;
+}
+
+int server_run(const char* socketPath, int loadFlags) {
+    struct sockaddr_un address;
+    if (socketAddress(socketPath, &address) != 0) return -1;
+
+    // A socket left behind by a server that did not shut down is replaced;
+    // a live server or any other kind of file is not.
+    struct stat info;
+    if (lstat(socketPath, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        int other = connectTo(&address);
+        if (other >= 0) {
+            close(other);
+            printf("Error: A server is already listening on %s\n", socketPath);
+            return -1;
+        }
+        unlink(socketPath);
+    }
+
+    // Jobs read and write files with this process's rights, so the socket is
+    // created owner-only whatever the umask: other users cannot connect.
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    int bound = -1;
+    if (listener >= 0) {
+        mode_t mask = umask(077);
+        bound = bind(listener, (const struct sockaddr*)&address, sizeof(address));
+        umask(mask);
+    }
+    if (listener < 0 || bound != 0 || listen(listener, 16) != 0) {
+        printf("Error: Cannot listen on %s: %s\n", socketPath, strerror(errno));
+        if (listener >= 0) close(listener);
+        return -1;
+    }
+
+    // No SA_RESTART: a signal interrupts accept() and the request reads, and
+    // the server stops after the job in progress.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Start the pool threads and pick the SIMD level before the first job.
+    cpu_simdLevel();
+    threadPool_parallelFor(threadPool_threadCount(), idleTask, NULL);
+
+    printf("Listening on %s with %d thread(s)\n", socketPath, threadPool_threadCount());
+    fflush(stdout);
+    int status = 0;
+    while (!stopRequested) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            printf("Error: Cannot accept a connection: %s\n", strerror(errno));
+            status = -1;
+            break;
+        }
+        serveConnection(connection, loadFlags);
+    }
+
+    close(listener);
+    unlink(socketPath);
+    return status;
+}
+
+// Absolute form of path, against the current directory.
+static int absolutePath(const char* path, char* out, size_t size) {
+    if (path[0] == '/') return snprintf(out, size, "%s", path) < (int)size ? 0 : -1;
+    char cwd[1024];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+    return snprintf(out, size, "%s/%s", cwd, path) < (int)size ? 0 : -1;
+}
+
+// Sends item's request and reads the reply; -1 when the connection is gone.
+static int submitItem(int fd, FILE* in, t_batchItem* item, const char* opText) {
+    char input[1024], output[1024];
+    if (absolutePath(item->input, input, sizeof(input)) != 0 ||
+        absolutePath(item->output, output, sizeof(output)) != 0 ||
+        strpbrk(input, "\t\n") || strpbrk(output, "\t\n")) {
+        snprintf(item->error, sizeof(item->error), "path cannot be sent to the server");
+        return 0;
+    }
+
+    char line[SERVER_LINE];
+    double rtt = timing_now();
+    if (dprintf(fd, "%s\t%s\t%s\n", input, opText, output) < 0 || readLine(in, line, sizeof(line)) < 0) {
+        snprintf(item->error, sizeof(item->error), "server closed the connection");
+        return -1;
+    }
+    rtt = timing_now() - rtt;
+
+    double total, load, process, save, pixels;
+    if (sscanf(line, "ok %lf %lf %lf %lf %lf", &total, &load, &process, &save, &pixels) == 5) {
+        // The round trip, as seen from here; the stages as timed by the server.
+        item->seconds = rtt;
+        item->loadSeconds = load / 1e3;
+        item->processSeconds = process / 1e3;
+        item->saveSeconds = save / 1e3;
+        item->pixels = pixels;
+    } else if (strncmp(line, "error ", 6) == 0) {
+        snprintf(item->error, sizeof(item->error), "%.159s", line + 6);
+    } else {
+        snprintf(item->error, sizeof(item->error), "unexpected reply: %.100s", line);
+    }
+    return 0;
+}
+
+int server_submit(const char* socketPath, t_batchItem* items, int count, const char* opText,
+                  t_batchReportFn report, void* context) {
+    if (strpbrk(opText, "\t\n")) {
+        printf("Error: Operations cannot contain tabs or newlines\n");
+        return -1;
+    }
+    struct sockaddr_un address;
+    if (socketAddress(socketPath, &address) != 0) return -1;
+    int fd = connectTo(&address);
+    if (fd < 0) {
+        printf("Error: Cannot connect to %s: %s\n", socketPath, strerror(errno));
+        return -1;
+    }
+    FILE* in = fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        printf("Error: Memory allocation failed\n");
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int failed = 0;
+    int connected = 1;
+    for (int i = 0; i < count; i++) {
+        t_batchItem* item = &items[i];
+        item->seconds = item->loadSeconds = item->processSeconds = item->saveSeconds = 0;
+        item->pixels = 0;
+        item->error[0] = '\0';
+        if (!connected) {
+            snprintf(item->error, sizeof(item->error), "server closed the connection");
+        } else if (submitItem(fd, in, item, opText) != 0) {
+            connected = 0;
+        }
+        if (item->error[0]) failed++;
+        if (report) report(context, item);
+    }
+    fclose(in);
+    return failed;
+}
+
+#endif
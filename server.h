@@ -0,0 +1,36 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "batch.h"
+
+// A resident worker for callers that would otherwise start the program once
+// per image: the thread pool, the buffer pool and the SIMD dispatch stay warm
+// between jobs. Jobs come over a Unix domain socket, one per line:
+//
+//     INPUT <tab> OPERATIONS <tab> OUTPUT
+//
+// with OPERATIONS as for op_parseList, and paths as the server sees them.
+// Each gets one line back:
+//
+//     ok <total ms> <load ms> <process ms> <save ms> <pixels>
+//     error <message>
+//
+// Connections are served one at a time, their jobs in order, each job using
+// the whole thread pool.
+
+// Listens on socketPath (replacing a stale socket there) until SIGINT or
+// SIGTERM, then removes it. The socket is created owner-only (umask 077), so
+// only the user running the server can submit jobs. Images are loaded with
+// loadFlags (see image_load). Returns 0, or -1 after printing why.
+int server_run(const char* socketPath, int loadFlags);
+
+// Sends each item to the server at socketPath over one connection with the
+// same operations, filling in the item's error or timings (seconds being the
+// round trip, the stages as timed by the server), and calls report (if any)
+// after each. Relative paths are resolved against the current directory
+// first. Returns the number of items that failed, or -1 after printing why
+// when the server cannot be reached.
+int server_submit(const char* socketPath, t_batchItem* items, int count, const char* opText,
+                  t_batchReportFn report, void* context);
+
+#endif
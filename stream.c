@@ -0,0 +1,347 @@
+#include "stream.h"
+#include "Histogram_equalization.h"
+#include "buffer_pool.h"
+#include "histogram.h"
+#include "pixel_format.h"
+#include "trace.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One BMP file opened for reading rows in file order.
+typedef struct {
+    FILE* file;
+    unsigned char* head;    // every byte before the pixel array
+    size_t headSize;
+    int width;
+    int height;             // absolute
+    int topDown;            // negative height in the header
+    int depth;              // 8 or 24
+    int fileRowSize;        // padded row in the file
+    int rowLen;             // row in memory: packed for 8-bit, as in the file for 24-bit
+} t_bmpStream;
+
+static unsigned int readU32(const unsigned char* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+static void closeStream(t_bmpStream* stream) {
+    if (stream->file) fclose(stream->file);
+    free(stream->head);
+    stream->file = NULL;
+    stream->head = NULL;
+}
+
+static int openStream(t_bmpStream* stream, const char* filename) {
+    memset(stream, 0, sizeof(*stream));
+    stream->file = fopen(filename, "rb");
+    if (!stream->file) {
+        printf("Error: Cannot open file %s\n", filename);
+        return -1;
+    }
+
+    unsigned char raw[54];
+    if (fread(raw, 1, sizeof(raw), stream->file) != sizeof(raw) || raw[0] != 'B' || raw[1] != 'M') {
+        printf("Error: Not a BMP file: %s\n", filename);
+        closeStream(stream);
+        return -1;
+    }
+    unsigned int offset = readU32(raw + 10);
+    int width = (int)readU32(raw + 18);
+    int height = (int)readU32(raw + 22);
+    int depth = raw[28] | (raw[29] << 8);
+    unsigned int compression = readU32(raw + 30);
+    if ((depth != 8 && depth != 24) || compression != 0 || width <= 0 || height == 0 || offset < sizeof(raw)) {
+        printf("Error: Only uncompressed 8-bit and 24-bit BMP files can be streamed: %s\n", filename);
+        closeStream(stream);
+        return -1;
+    }
+    // Padded rows must fit an int, and INT_MIN has no absolute value.
+    if (width > (INT_MAX - 3) / 3 || height == INT_MIN) {
+        printf("Error: Invalid BMP file format: %s\n", filename);
+        closeStream(stream);
+        return -1;
+    }
+
+    stream->headSize = offset;
+    stream->head = (unsigned char*)malloc(offset);
+    if (!stream->head) {
+        printf("Error: Memory allocation failed\n");
+        closeStream(stream);
+        return -1;
+    }
+    memcpy(stream->head, raw, sizeof(raw));
+    if (fread(stream->head + sizeof(raw), 1, offset - sizeof(raw), stream->file) != offset - sizeof(raw)) {
+        printf("Error: Truncated BMP header: %s\n", filename);
+        closeStream(stream);
+        return -1;
+    }
+    trace_add(TRACE_BYTES_READ, offset);
+
+    // Strips are sized from the header; a file shorter than it promises
+    // fails here rather than after they are allocated.
+    long long rows = (((long long)width * (depth / 8)) + 3) / 4 * 4 * (height < 0 ? -(long long)height : height);
+    long fileSize = fseek(stream->file, 0, SEEK_END) == 0 ? ftell(stream->file) : -1;
+    if (fileSize < 0 || fileSize - (long long)offset < rows || fseek(stream->file, offset, SEEK_SET) != 0) {
+        printf("Error: Unexpected end of pixel data\n");
+        closeStream(stream);
+        return -1;
+    }
+
+    stream->width = width;
+    stream->height = height < 0 ? -height : height;
+    stream->topDown = height < 0;
+    stream->depth = depth;
+    stream->fileRowSize = ((width * (depth / 8)) + 3) & ~3;
+    stream->rowLen = depth == 8 ? width : stream->fileRowSize;
+    return 0;
+}
+
+// Reads the next count rows of the file into rows, rowLen bytes apart.
+static int readRows(t_bmpStream* stream, unsigned char* rows, int count) {
+    size_t bytes = (size_t)stream->fileRowSize * count;
+    if (fread(rows, 1, bytes, stream->file) != bytes) return -1;
+    trace_add(TRACE_BYTES_READ, bytes);
+    if (stream->rowLen != stream->fileRowSize) {
+        // Drop the 8-bit row padding; moving forward never overwrites unread rows.
+        for (int r = 1; r < count; r++) {
+            memmove(rows + (size_t)r * stream->rowLen, rows + (size_t)r * stream->fileRowSize, stream->rowLen);
+        }
+    }
+    return 0;
+}
+
+static int writeRows(const t_bmpStream* stream, FILE* out, unsigned char* rows, int count) {
+    int dataBytes = stream->width * (stream->depth / 8);
+    int padding = stream->fileRowSize - dataBytes;
+    static const unsigned char zeros[4] = { 0, 0, 0, 0 };
+    if (stream->rowLen == stream->fileRowSize) {
+        for (int r = 0; padding && r < count; r++) {
+            memset(rows + (size_t)r * stream->rowLen + dataBytes, 0, padding);
+        }
+        size_t bytes = (size_t)stream->rowLen * count;
+        if (fwrite(rows, 1, bytes, out) != bytes) return -1;
+        trace_add(TRACE_BYTES_WRITTEN, bytes);
+        return 0;
+    }
+    for (int r = 0; r < count; r++) {
+        if (fwrite(rows + (size_t)r * stream->rowLen, 1, dataBytes, out) != (size_t)dataBytes) return -1;
+        if (padding && fwrite(zeros, 1, padding, out) != (size_t)padding) return -1;
+    }
+    trace_add(TRACE_BYTES_WRITTEN, (uint64_t)stream->fileRowSize * count);
+    return 0;
+}
+
+// The image made of count rows held in file order, as the operations see it.
+typedef struct {
+    t_bmp8 gray;
+    t_bmp24 color;
+    t_image image;
+} t_strip;
+
+static void wrapStrip(const t_bmpStream* stream, unsigned char* rows, int count, t_strip* strip) {
+    memset(strip, 0, sizeof(*strip));
+    if (stream->depth == 8) {
+        // bmp8 images keep their rows in file order.
+        strip->gray.data = rows;
+        strip->gray.width = stream->width;
+        strip->gray.height = count;
+        strip->gray.colorDepth = 8;
+        strip->gray.dataSize = (unsigned int)stream->width * count;
+        strip->gray.stride = (unsigned int)stream->rowLen;
+        strip->image.gray = &strip->gray;
+    } else {
+        // bmp24 images address rows top-down from data.
+        strip->color.width = stream->width;
+        strip->color.height = count;
+        strip->color.colorDepth = 24;
+        strip->color.channels = PIXEL_BGR24;
+        strip->color.stride = stream->topDown ? stream->rowLen : -stream->rowLen;
+        strip->color.data = stream->topDown ? rows : rows + (size_t)(count - 1) * stream->rowLen;
+        strip->image.color = &strip->color;
+    }
+}
+
+// One streamed pass: the optional equalization remap, then ops.
+typedef struct {
+    const unsigned char* remap;     // table applied first, or NULL
+    const t_operation* ops;
+    int count;
+    unsigned int* histogram;        // gets the histogram of the finished rows, or NULL
+} t_pass;
+
+static int runPass(t_bmpStream* in, FILE* out, const t_pass* pass, int stripRows, t_streamStats* stats) {
+    int halo = 0;
+    for (int k = 0; k < pass->count; k++) {
+        halo += op_radius(&pass->ops[k]);
+    }
+    if (halo > in->height) halo = in->height;
+
+    // work holds the original rows [lo, hi) of the strip being processed;
+    // kept holds the original rows [keptLo, keptHi) the next strip reuses.
+    size_t rowLen = in->rowLen;
+    size_t workRows = (size_t)stripRows + 2 * (size_t)halo;
+    unsigned char* work = (unsigned char*)bufferPool_get((workRows + 2 * (size_t)halo) * rowLen, 0);
+    if (!work) {
+        printf("Error: Memory allocation failed for a %d-row strip\n", stripRows);
+        return -1;
+    }
+    unsigned char* kept = work + workRows * rowLen;
+    size_t bytes = (workRows + 2 * (size_t)halo) * rowLen;
+    if (bytes > stats->peakBytes) stats->peakBytes = bytes;
+
+    int keptLo = 0, keptHi = 0;
+    int status = 0;
+    for (int s0 = 0; s0 < in->height && status == 0; s0 += stripRows) {
+        int s1 = s0 + stripRows < in->height ? s0 + stripRows : in->height;
+        int lo = s0 - halo > 0 ? s0 - halo : 0;
+        int hi = s1 + halo < in->height ? s1 + halo : in->height;
+
+        // Rows [lo, keptHi) come from the previous strip, the rest from the file.
+        int reused = keptHi - lo > 0 ? keptHi - lo : 0;
+        memcpy(work, kept + (size_t)(lo - keptLo) * rowLen, (size_t)reused * rowLen);
+        if (readRows(in, work + (size_t)reused * rowLen, hi - lo - reused) != 0) {
+            printf("Error: Unexpected end of pixel data\n");
+            status = -1;
+            break;
+        }
+        keptLo = s1 - halo > 0 ? s1 - halo : 0;
+        if (keptLo < lo) keptLo = lo;
+        keptHi = hi;
+        memcpy(kept, work + (size_t)(keptLo - lo) * rowLen, (size_t)(keptHi - keptLo) * rowLen);
+
+        t_strip strip;
+        wrapStrip(in, work, hi - lo, &strip);
+        if (pass->remap) {
+            if (strip.image.gray) {
+                bmp8_equalizeWith(strip.image.gray, pass->remap);
+            } else {
+                bmp24_equalizeWith(strip.image.color, pass->remap);
+            }
+        }
+        int failed;
+        if (op_applyList(&strip.image, pass->ops, pass->count, &failed) != 0) {
+            printf("Error: %s is not available for %d-bit images\n", op_name(pass->ops[failed].type), in->depth);
+            status = -1;
+            break;
+        }
+
+        // Finished rows [s0, s1).
+        unsigned char* done = work + (size_t)(s0 - lo) * rowLen;
+        if (pass->histogram) {
+            if (in->depth == 8) {
+                histogram_add(done, (size_t)in->width * (s1 - s0), pass->histogram);
+            } else {
+                t_strip finished;
+                wrapStrip(in, done, s1 - s0, &finished);
+                bmp24_addLumaHistogram(finished.image.color, pass->histogram);
+            }
+        }
+        if (out && writeRows(in, out, done, s1 - s0) != 0) {
+            printf("Error: Could not write strip output\n");
+            status = -1;
+        }
+    }
+
+    bufferPool_release(work);
+    return status;
+}
+
+// Streams source through pass into destination (or nowhere when NULL).
+static int streamFile(const char* source, const char* destination, const t_pass* pass,
+                      int stripRows, t_streamStats* stats) {
+    t_bmpStream in;
+    if (openStream(&in, source) != 0) return -1;
+    stats->width = in.width;
+    stats->height = in.height;
+    stats->passes++;
+
+    FILE* out = NULL;
+    if (destination) {
+        out = fopen(destination, "wb");
+        if (!out) {
+            printf("Error: Cannot create file %s\n", destination);
+            closeStream(&in);
+            return -1;
+        }
+        if (fwrite(in.head, 1, in.headSize, out) != in.headSize) {
+            printf("Error: Could not write file %s\n", destination);
+            fclose(out);
+            closeStream(&in);
+            return -1;
+        }
+        trace_add(TRACE_BYTES_WRITTEN, in.headSize);
+    }
+
+    double start = trace_begin();
+    int status = runPass(&in, out, pass, stripRows, stats);
+    if (out && fclose(out) != 0) status = -1;
+    closeStream(&in);
+    trace_end("stream_pass", start);
+    return status;
+}
+
+int stream_process(const char* input, const char* output, const t_operation* ops, int count,
+                   int stripRows, t_streamStats* stats) {
+    double start = trace_begin();
+    t_streamStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (stripRows <= 0) stripRows = 1;
+    for (int k = 0; k < count; k++) {
+        if (ops[k].type == OP_CLAHE) {
+            printf("Error: %s works on the whole image and cannot be streamed\n", op_name(ops[k].type));
+            trace_end("stream_process", start);
+            return -1;
+        }
+        if (ops[k].type == OP_TO_GRAY8) {
+            printf("Error: %s changes the image depth and cannot be streamed\n", op_name(ops[k].type));
+            trace_end("stream_process", start);
+            return -1;
+        }
+    }
+
+    // Temporaries alternate between two names next to the output.
+    char temporary[2][1024];
+    for (int t = 0; t < 2; t++) {
+        snprintf(temporary[t], sizeof(temporary[t]), "%s.part%d", output, t);
+    }
+
+    const char* source = input;
+    unsigned char lut[256];
+    const unsigned char* remap = NULL;
+    int next = 0;
+    int status = 0;
+
+    while (status == 0) {
+        // This pass runs up to the next equalize, which needs its histogram.
+        int end = next;
+        while (end < count && ops[end].type != OP_EQUALIZE) {
+            end++;
+        }
+        int last = end == count;
+
+        unsigned int hist[256] = {0};
+        t_pass pass = { remap, ops + next, end - next, last ? NULL : hist };
+        const char* destination = output;
+        if (!last) {
+            // Nothing to change before the equalize: only count the source.
+            destination = remap || end > next ? temporary[source == temporary[0]] : NULL;
+        }
+        status = streamFile(source, destination, &pass, stripRows, stats);
+
+        if (source != input && destination) remove(source);
+        if (destination) source = destination;
+        if (last || status != 0) break;
+
+        equalize_table(hist, (unsigned int)stats->width * stats->height, lut);
+        remap = lut;
+        next = end + 1;
+    }
+
+    // Leave no partial output or temporaries behind.
+    if (status != 0 && source != input) remove(source);
+    trace_end("stream_process", start);
+    return status;
+}
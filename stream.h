@@ -0,0 +1,37 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "operations.h"
+
+typedef struct {
+    int width;
+    int height;
+    int passes;             // reads over a full-size image, temporaries included
+    size_t peakBytes;       // largest amount of pixel memory held at once
+} t_streamStats;
+
+// Applies ops to the BMP file input and writes the result to output without
+// loading the whole image: rows are read in strips of stripRows, each with
+// the rows of context its operations need above and below, and every
+// finished strip is written out before the next one is read. Pixel memory is
+// about (stripRows + 4 * halo) rows, halo being the sum of the operations'
+// radii, whatever the image height.
+//
+// Equalize needs the histogram of the whole image, so it splits the chain:
+// the histogram is gathered while the preceding operations stream out (to a
+// temporary file next to output when there are any), and the remap then runs
+// as the first step of the next streamed pass. Clahe's tiles span the whole
+// image and to_gray8 changes the file's layout; both are refused.
+//
+// The pixel array is the one in-memory processing saves, byte for byte, at
+// any width: both leave row padding out of the operations and write it as
+// zeros. Header bytes past the first 54 (V4/V5 info fields, palettes) are
+// copied from the input, where a 24-bit in-memory save writes zeros, so the
+// whole files match only for 40-byte info headers.
+//
+// Returns 0, or -1 after printing the error; a failed run leaves no output or
+// temporary files behind. stats may be NULL.
+int stream_process(const char* input, const char* output, const t_operation* ops, int count,
+                   int stripRows, t_streamStats* stats);
+
+#endif
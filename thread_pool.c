@@ -0,0 +1,249 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_THREADS 256
+#define BANDS_PER_THREAD 4
+
+// Remaining task indices of one thread: next in the low 32 bits, end in the
+// high 32 bits, so the owner and thieves can both claim with one CAS.
+typedef struct {
+    _Atomic uint64_t range;
+    char padding[64 - sizeof(uint64_t)];
+} t_range;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t busy = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t workers[MAX_THREADS];
+static t_range ranges[MAX_THREADS];
+static int requestedThreads = 0;
+static int runningThreads = 0;    // threads taking part in jobs, caller included
+static unsigned long generation = 0;
+static int stopping = 0;
+static int active = 0;
+static t_taskFn currentTask;
+static void* currentContext;
+
+static _Thread_local int insidePool = 0;
+
+static int coreCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+static int desiredThreads(void) {
+    int threads = requestedThreads;
+    if (threads <= 0) {
+        const char* env = getenv("BMP_THREADS");
+        threads = env ? atoi(env) : 0;
+    }
+    if (threads <= 0) threads = coreCount();
+    return threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+static int popFront(t_range* range) {
+    uint64_t current = atomic_load(&range->range);
+    for (;;) {
+        uint32_t next = (uint32_t)current;
+        uint32_t end = (uint32_t)(current >> 32);
+        if (next >= end) return -1;
+        uint64_t claimed = ((uint64_t)end << 32) | (next + 1);
+        if (atomic_compare_exchange_weak(&range->range, &current, claimed)) return (int)next;
+    }
+}
+
+static int popBack(t_range* range) {
+    uint64_t current = atomic_load(&range->range);
+    for (;;) {
+        uint32_t next = (uint32_t)current;
+        uint32_t end = (uint32_t)(current >> 32);
+        if (next >= end) return -1;
+        uint64_t claimed = ((uint64_t)(end - 1) << 32) | next;
+        if (atomic_compare_exchange_weak(&range->range, &current, claimed)) return (int)end - 1;
+    }
+}
+
+// Own range first, then steal; ranges only ever shrink, so one sweep over
+// the other threads is enough to see the job drained.
+static void runTasks(int self) {
+    int index;
+    while ((index = popFront(&ranges[self])) >= 0) {
+        currentTask(currentContext, index);
+    }
+    for (int k = 1; k < runningThreads; k++) {
+        t_range* victim = &ranges[(self + k) % runningThreads];
+        while ((index = popBack(victim)) >= 0) {
+            currentTask(currentContext, index);
+        }
+    }
+}
+
+static void* workerMain(void* argument) {
+    int self = (int)(intptr_t)argument;
+    unsigned long seen = 0;
+    insidePool = 1;
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!stopping && generation == seen) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) break;
+        seen = generation;
+        pthread_mutex_unlock(&lock);
+
+        runTasks(self);
+
+        pthread_mutex_lock(&lock);
+        if (--active == 0) pthread_cond_signal(&finished);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static void stopWorkers(void) {
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (int k = 1; k < runningThreads; k++) {
+        pthread_join(workers[k], NULL);
+    }
+    stopping = 0;
+    runningThreads = 0;
+}
+
+static void shutdownPool(void) {
+    pthread_mutex_lock(&busy);
+    stopWorkers();
+    pthread_mutex_unlock(&busy);
+}
+
+// Called with busy held.
+static void startWorkers(void) {
+    static int registered = 0;
+    int threads = desiredThreads();
+    if (threads == runningThreads) return;
+    if (runningThreads > 0) stopWorkers();
+    if (!registered) {
+        atexit(shutdownPool);
+        registered = 1;
+    }
+
+    generation = 0;
+    runningThreads = 1;
+    for (int k = 1; k < threads; k++) {
+        if (pthread_create(&workers[k], NULL, workerMain, (void*)(intptr_t)k) != 0) break;
+        runningThreads++;
+    }
+}
+
+void threadPool_parallelFor(int count, t_taskFn task, void* context) {
+    if (count <= 0 || !task) return;
+
+    if (count == 1 || insidePool || pthread_mutex_trylock(&busy) != 0) {
+        for (int index = 0; index < count; index++) {
+            task(context, index);
+        }
+        return;
+    }
+
+    startWorkers();
+    if (runningThreads <= 1) {
+        pthread_mutex_unlock(&busy);
+        for (int index = 0; index < count; index++) {
+            task(context, index);
+        }
+        return;
+    }
+
+    for (int k = 0; k < runningThreads; k++) {
+        uint64_t begin = (uint64_t)count * k / runningThreads;
+        uint64_t end = (uint64_t)count * (k + 1) / runningThreads;
+        atomic_store(&ranges[k].range, (end << 32) | begin);
+    }
+    currentTask = task;
+    currentContext = context;
+
+    pthread_mutex_lock(&lock);
+    active = runningThreads - 1;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    insidePool = 1;
+    runTasks(0);
+    insidePool = 0;
+
+    pthread_mutex_lock(&lock);
+    while (active > 0) {
+        pthread_cond_wait(&finished, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&busy);
+}
+
+typedef struct {
+    int count;
+    int bands;
+    t_bandFn fn;
+    void* context;
+} t_bands;
+
+static void runBand(void* context, int index) {
+    t_bands* bands = (t_bands*)context;
+    int begin = (int)((long long)bands->count * index / bands->bands);
+    int end = (int)((long long)bands->count * (index + 1) / bands->bands);
+    if (begin < end) bands->fn(bands->context, begin, end);
+}
+
+int threadPool_bandCount(int count, int minBand) {
+    if (count <= 0) return 0;
+    if (minBand < 1) minBand = 1;
+    int threads = threadPool_threadCount();
+    if (threads <= 1) return 1;
+    int bands = threads * BANDS_PER_THREAD;
+    int most = (count + minBand - 1) / minBand;
+    return bands < most ? bands : most;
+}
+
+void threadPool_forBands(int count, int minBand, t_bandFn fn, void* context) {
+    int bands = threadPool_bandCount(count, minBand);
+    if (bands <= 1) {
+        if (count > 0) fn(context, 0, count);
+        return;
+    }
+    t_bands split = { count, bands, fn, context };
+    threadPool_parallelFor(bands, runBand, &split);
+}
+
+void threadPool_setThreadCount(int threads) {
+    pthread_mutex_lock(&busy);
+    requestedThreads = threads;
+    pthread_mutex_unlock(&busy);
+}
+
+int threadPool_threadCount(void) {
+    return desiredThreads();
+}
@@ -0,0 +1,25 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+typedef void (*t_taskFn)(void* context, int index);
+typedef void (*t_bandFn)(void* context, int begin, int end);
+
+// Runs task(context, index) for every index in [0, count) and returns once all
+// have finished. Indices are dealt out as one contiguous range per thread;
+// a thread that runs dry steals from the back of the others' ranges. Calls
+// made from inside a task, or while another thread is using the pool, run
+// serially on the calling thread.
+void threadPool_parallelFor(int count, t_taskFn task, void* context);
+
+// Splits [0, count) into contiguous bands of at least minBand items and runs
+// fn on each in parallel. The split only depends on the thread count, and
+// callers keep results independent of it.
+void threadPool_forBands(int count, int minBand, t_bandFn fn, void* context);
+int threadPool_bandCount(int count, int minBand);
+
+// 0 selects one thread per core (or BMP_THREADS when set). Takes effect on
+// the next parallel call.
+void threadPool_setThreadCount(int threads);
+int threadPool_threadCount(void);
+
+#endif
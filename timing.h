@@ -0,0 +1,7 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+// Monotonic wall clock in seconds, for measuring intervals only.
+double timing_now(void);
+
+#endif
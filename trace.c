@@ -0,0 +1,143 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One finished scope, with the counters as they stood when it ended.
+typedef struct {
+    const char* name;
+    int thread;
+    double start;
+    double end;
+    uint64_t counters[TRACE_COUNTER_COUNT];
+} t_traceEvent;
+
+static const char* COUNTER_NAMES[TRACE_COUNTER_COUNT] = {
+    "bytes_read", "bytes_written", "pixels", "bytes_allocated"
+};
+
+volatile int trace_enabled = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static t_traceEvent* events = NULL;
+static size_t eventCount = 0;
+static size_t eventCapacity = 0;
+static char* outputPath = NULL;
+static double origin = 0;
+static _Atomic uint64_t counters[TRACE_COUNTER_COUNT];
+static atomic_int threadCount = 0;
+static _Thread_local int threadId = 0;
+
+static void stopAtExit(void) {
+    trace_stop();
+}
+
+int trace_start(const char* filename) {
+    static int registered = 0;
+    char* path = (char*)malloc(strlen(filename) + 1);
+    if (!path) {
+        printf("Error: Memory allocation failed\n");
+        return -1;
+    }
+    strcpy(path, filename);
+
+    pthread_mutex_lock(&lock);
+    free(outputPath);
+    outputPath = path;
+    eventCount = 0;
+    for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+        atomic_store(&counters[c], 0);
+    }
+    origin = timing_now();
+    trace_enabled = 1;
+    if (!registered) {
+        atexit(stopAtExit);
+        registered = 1;
+    }
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+void trace_count(t_traceCounter counter, uint64_t amount) {
+    atomic_fetch_add_explicit(&counters[counter], amount, memory_order_relaxed);
+}
+
+void trace_record(const char* name, double start) {
+    double end = timing_now();
+    if (threadId == 0) threadId = atomic_fetch_add(&threadCount, 1) + 1;
+
+    pthread_mutex_lock(&lock);
+    if (trace_enabled && start >= origin) {
+        if (eventCount == eventCapacity) {
+            size_t capacity = eventCapacity ? eventCapacity * 2 : 1024;
+            t_traceEvent* grown = (t_traceEvent*)realloc(events, capacity * sizeof(t_traceEvent));
+            if (!grown) {
+                pthread_mutex_unlock(&lock);
+                return;
+            }
+            events = grown;
+            eventCapacity = capacity;
+        }
+        t_traceEvent* event = &events[eventCount++];
+        event->name = name;
+        event->thread = threadId;
+        event->start = start;
+        event->end = end;
+        for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+            event->counters[c] = atomic_load_explicit(&counters[c], memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Every scope becomes a complete ("X") event; a counter ("C") event at its
+// end lets the viewer plot the totals over time.
+static int writeEvents(FILE* file) {
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < eventCount; i++) {
+        const t_traceEvent* event = &events[i];
+        double ts = (event->start - origin) * 1e6;
+        double end = (event->end - origin) * 1e6;
+        fprintf(file, "{\"name\": \"%s\", \"cat\": \"bmp\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                      "\"ts\": %.3f, \"dur\": %.3f},\n",
+                event->name, event->thread, ts, end - ts);
+        fprintf(file, "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {", end);
+        for (int c = 0; c < TRACE_COUNTER_COUNT; c++) {
+            fprintf(file, "%s\"%s\": %llu", c ? ", " : "", COUNTER_NAMES[c],
+                    (unsigned long long)event->counters[c]);
+        }
+        fprintf(file, "}},\n");
+    }
+    // The final metadata record saves tracking the last comma above.
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"bmp\"}}\n]}\n");
+    return ferror(file) ? -1 : 0;
+}
+
+int trace_stop(void) {
+    pthread_mutex_lock(&lock);
+    if (!trace_enabled || !outputPath) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    trace_enabled = 0;
+
+    int status = -1;
+    FILE* file = fopen(outputPath, "w");
+    if (!file) {
+        printf("Error: Cannot create trace file %s\n", outputPath);
+    } else {
+        status = writeEvents(file);
+        if (fclose(file) != 0) status = -1;
+        if (status != 0) printf("Error: Could not write trace file %s\n", outputPath);
+    }
+
+    free(events);
+    events = NULL;
+    eventCount = eventCapacity = 0;
+    free(outputPath);
+    outputPath = NULL;
+    pthread_mutex_unlock(&lock);
+    return status;
+}
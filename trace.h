@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "timing.h"
+
+typedef enum {
+    TRACE_BYTES_READ = 0,
+    TRACE_BYTES_WRITTEN,
+    TRACE_PIXELS,
+    TRACE_BYTES_ALLOCATED,
+    TRACE_COUNTER_COUNT
+} t_traceCounter;
+
+// Tracing is off until trace_start(); while off, a scope costs one load and
+// branch at each end. Names must be string literals: only the pointer is kept.
+//
+//     double start = trace_begin();
+//     ...
+//     trace_add(TRACE_PIXELS, pixels);
+//     trace_end("bmp24_sharpen", start);
+extern volatile int trace_enabled;
+
+// Starts recording; the events are written to filename, in the Chrome
+// trace_event JSON format, by trace_stop() or at exit. Returns 0 or -1.
+int trace_start(const char* filename);
+int trace_stop(void);
+
+void trace_record(const char* name, double start);
+void trace_count(t_traceCounter counter, uint64_t amount);
+
+static inline double trace_begin(void) {
+    return trace_enabled ? timing_now() : 0;
+}
+
+static inline void trace_end(const char* name, double start) {
+    if (trace_enabled && start > 0) trace_record(name, start);
+}
+
+static inline void trace_add(t_traceCounter counter, uint64_t amount) {
+    if (trace_enabled) trace_count(counter, amount);
+}
+
+#endif